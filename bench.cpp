@@ -0,0 +1,162 @@
+#include "interpreter.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <new>
+
+// Heap allocations and time per call of user-defined functions, for each
+// execution tier. Every loop iteration makes one call; the "loop only" row
+// is the same loop calling an operator instead, for subtracting. The
+// "frame" rows time making and dropping a call frame by itself, and the
+// "refcount" rows what reference counting costs.
+
+static size_t allocations = 0;
+
+void *operator new(size_t n)
+{
+    allocations++;
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+using namespace squirrel;
+
+struct Case {
+    const char *name;
+    const char *body;
+};
+
+static const Case cases[] = {
+    {"loop only", "+ i 2"},
+    {"no params", "zero"},
+    {"two params", "add2 i 2"},
+    {"four params", "add4 i 2 3 4"},
+    {"rest params", "rest i 2 3"},
+    {"nested calls", "add2 {add2 i 1} 2"},
+};
+
+static const char *defs[] = {
+    "func zero {} 0",
+    "func add2 {a b} {+ a b}",
+    "func add4 {a b c d} {+ a b c d}",
+    "func rest '{xs} xs",
+};
+
+static const struct { const char *name; int tier; } tiers[] = {
+    {"tree", ExecTier::TREE},
+    {"spec", ExecTier::SPECIALIZE},
+    {"bytecode", ExecTier::BYTECODE},
+    {"jit", ExecTier::JIT},
+};
+
+// Making a two-slot function frame and dropping it, from the interpreter's
+// frame arena and, for comparison, from the heap
+static void bench_frames(int iterations)
+{
+    Interpreter interp;
+    SymbolPtr name = Symbol::make("f");
+    SlotLayoutPtr layout = SlotLayout::make();
+    layout->add(Symbol::make("a"));
+    layout->add(Symbol::make("b"));
+    
+    for (int heap=0; heap<2; heap++) {
+        size_t before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++) {
+            ContextPtr c = heap ? interp.global->make_child_context(Symbol::func_symbol, name) : interp.global->make_function_context(name);
+            c->vars.use_layout(layout);
+            c->vars.set_slot(0, Value::ONE_INT);
+        }
+        auto end = std::chrono::steady_clock::now();
+        size_t count = allocations - before;
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        printf("%-14s %-10s %12.2f %10.1f\n", "frame", heap ? "heap" : "arena", double(count) / iterations, ns / iterations);
+    }
+}
+
+// Times k at tier, in a fresh interpreter
+static void bench_case(const Case& k, const char *tier_name, int tier, int iterations)
+{
+    std::streambuf *out = std::cout.rdbuf(0);
+    Interpreter interp;
+    interp.tier = tier;
+    for (const char *d : defs) interp.evaluate(d);
+    std::string drive = std::string("func drive {n} {for i 0 n {") + k.body + "}}";
+    interp.evaluate(drive);
+    interp.evaluate("drive 100");
+
+    std::string run = "drive " + std::to_string(iterations);
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    interp.evaluate(run);
+    auto end = std::chrono::steady_clock::now();
+    size_t count = allocations - before;
+    std::cout.rdbuf(out);
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("%-14s %-10s %12.2f %10.1f\n", k.name, tier_name, double(count) / iterations, ns / iterations);
+}
+
+// The call-heavy cases with every count atomic, as while argument workers
+// run, against the plain counts used otherwise; then copying a handle over
+// one to another object, with each kind of count and with std::shared_ptr
+static void bench_refcounts(int iterations)
+{
+    const Case *heavy[] = {&cases[2], &cases[5]};
+    for (const Case *k : heavy) {
+        for (int atomic=0; atomic<2; atomic++) {
+            RefCounted::threaded = atomic;
+            bench_case(*k, atomic ? "atomic" : "plain", ExecTier::BYTECODE, iterations);
+        }
+    }
+    RefCounted::threaded = false;
+
+    // As inside an evaluation, where the lists are candidates after the
+    // first copy goes
+    Interpreter interp;
+    CycleCollector::Use gc(&interp.collector);
+    int copies = iterations * 100;
+    ListValuePtr lists[2] = {ListValue::make(), ListValue::make()};
+    std::shared_ptr<int> shared[2] = {std::make_shared<int>(0), std::make_shared<int>(1)};
+    ListValuePtr list_copies[16];
+    std::shared_ptr<int> shared_copies[16];
+    for (int kind=0; kind<3; kind++) {
+        RefCounted::threaded = kind == 1;
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<copies; i++) {
+            if (kind < 2) {
+                list_copies[i & 15] = lists[(i >> 4) & 1];
+            } else {
+                shared_copies[i & 15] = shared[(i >> 4) & 1];
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        printf("%-14s %-10s %12.2f %10.1f\n", "refcount", kind == 0 ? "plain" : kind == 1 ? "atomic" : "shared_ptr", 0.0, ns / copies);
+    }
+    RefCounted::threaded = false;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+    // The interpreter traces to stdout as it goes; the bench doesn't want
+    // the output, but the allocations made for it still count
+    std::streambuf *out = std::cout.rdbuf();
+
+    printf("%-14s %-10s %12s %10s\n", "case", "tier", "allocs/call", "ns/call");
+    for (auto& t : tiers) {
+        for (auto& k : cases) bench_case(k, t.name, t.tier, iterations);
+    }
+    
+    std::cout.rdbuf(0);
+    bench_frames(iterations);
+    bench_refcounts(iterations);
+    std::cout.rdbuf(out);
+    return 0;
+}
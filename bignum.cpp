@@ -0,0 +1,249 @@
+#include "bignum.hpp"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <cctype>
+
+namespace squirrel {
+
+typedef std::vector<uint32_t> Digits;
+
+static int compare_mag(const Digits& a, const Digits& b)
+{
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static Digits add_mag(const Digits& a, const Digits& b)
+{
+    const Digits& x = a.size() >= b.size() ? a : b;
+    const Digits& y = a.size() >= b.size() ? b : a;
+    Digits r(x.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i=0; i<x.size(); i++) {
+        uint64_t s = carry + x[i] + (i < y.size() ? y[i] : 0);
+        r[i] = uint32_t(s);
+        carry = s >> 32;
+    }
+    r[x.size()] = uint32_t(carry);
+    return r;
+}
+
+// a - b, for a >= b
+static Digits sub_mag(const Digits& a, const Digits& b)
+{
+    Digits r(a.size());
+    int64_t borrow = 0;
+    for (size_t i=0; i<a.size(); i++) {
+        int64_t d = int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = d < 0;
+        r[i] = uint32_t(d + (borrow << 32));
+    }
+    return r;
+}
+
+static Digits mul_mag(const Digits& a, const Digits& b)
+{
+    if (a.empty() || b.empty()) return Digits();
+    Digits r(a.size() + b.size());
+    for (size_t i=0; i<a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j=0; j<b.size(); j++) {
+            uint64_t t = uint64_t(a[i]) * b[j] + r[i+j] + carry;
+            r[i+j] = uint32_t(t);
+            carry = t >> 32;
+        }
+        r[i+b.size()] = uint32_t(carry);
+    }
+    return r;
+}
+
+// Divides a in place by d, returning the remainder
+static uint32_t divmod_small(Digits& a, uint32_t d)
+{
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+        uint64_t cur = (rem << 32) | a[i];
+        a[i] = uint32_t(cur / d);
+        rem = cur % d;
+    }
+    while (!a.empty() && a.back() == 0) a.pop_back();
+    return uint32_t(rem);
+}
+
+// a = a * m + add
+static void mul_add_small(Digits& a, uint32_t m, uint32_t add)
+{
+    uint64_t carry = add;
+    for (size_t i=0; i<a.size(); i++) {
+        uint64_t t = uint64_t(a[i]) * m + carry;
+        a[i] = uint32_t(t);
+        carry = t >> 32;
+    }
+    if (carry) a.push_back(uint32_t(carry));
+}
+
+BigInt::BigInt(int64_t v)
+{
+    negative = v < 0;
+    uint64_t m = negative ? 0 - uint64_t(v) : uint64_t(v);
+    mag.push_back(uint32_t(m));
+    mag.push_back(uint32_t(m >> 32));
+    trim();
+}
+
+void BigInt::trim()
+{
+    while (!mag.empty() && mag.back() == 0) mag.pop_back();
+    if (mag.empty()) negative = false;
+}
+
+BigInt BigInt::parse(const char *s, int len)
+{
+    BigInt r;
+    int i = 0;
+    bool neg = false;
+    if (i < len && (s[i] == '-' || s[i] == '+')) neg = s[i++] == '-';
+    for (; i < len && isdigit(s[i]); i++) mul_add_small(r.mag, 10, s[i] - '0');
+    r.negative = neg;
+    r.trim();
+    return r;
+}
+
+BigInt BigInt::from_double(double d)
+{
+    BigInt r;
+    if (!std::isfinite(d)) return r;
+    d = std::trunc(d);
+    r.negative = d < 0;
+    d = std::fabs(d);
+    while (d >= 1) {
+        r.mag.push_back(uint32_t(std::fmod(d, 4294967296.0)));
+        d = std::floor(d / 4294967296.0);
+    }
+    r.trim();
+    return r;
+}
+
+bool BigInt::fits_int64() const
+{
+    if (mag.size() > 2) return false;
+    uint64_t m = mag.size() > 1 ? (uint64_t(mag[1]) << 32) | mag[0] : mag.empty() ? 0 : mag[0];
+    return negative ? m <= (uint64_t(1) << 63) : m < (uint64_t(1) << 63);
+}
+
+int64_t BigInt::to_int64() const
+{
+    uint64_t m = mag.size() > 1 ? (uint64_t(mag[1]) << 32) | mag[0] : mag.empty() ? 0 : mag[0];
+    return int64_t(negative ? 0 - m : m);
+}
+
+double BigInt::to_double() const
+{
+    double d = 0;
+    for (size_t i = mag.size(); i-- > 0;) d = d * 4294967296.0 + mag[i];
+    return negative ? -d : d;
+}
+
+std::string BigInt::to_string() const
+{
+    if (mag.empty()) return "0";
+    Digits m = mag;
+    std::vector<uint32_t> parts;
+    while (!m.empty()) parts.push_back(divmod_small(m, 1000000000));
+    std::string s = negative ? "-" : "";
+    s += std::to_string(parts.back());
+    for (size_t i = parts.size() - 1; i-- > 0;) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%09u", parts[i]);
+        s += buf;
+    }
+    return s;
+}
+
+size_t BigInt::bits() const
+{
+    if (mag.empty()) return 0;
+    size_t n = (mag.size() - 1) * 32;
+    for (uint32_t top = mag.back(); top; top >>= 1) n++;
+    return n;
+}
+
+int BigInt::compare(const BigInt& a, const BigInt& b)
+{
+    if (a.negative != b.negative) return a.negative ? -1 : 1;
+    int c = compare_mag(a.mag, b.mag);
+    return a.negative ? -c : c;
+}
+
+void BigInt::divmod(const BigInt& a, const BigInt& b, BigInt& q, BigInt& r)
+{
+    q = BigInt();
+    r = BigInt();
+    if (b.mag.size() == 1) {
+        q.mag = a.mag;
+        uint32_t rem = divmod_small(q.mag, b.mag[0]);
+        if (rem) r.mag.push_back(rem);
+    } else if (compare_mag(a.mag, b.mag) < 0) {
+        r.mag = a.mag;
+    } else {
+        // Shift and subtract, one bit of the quotient at a time
+        size_t n = a.bits();
+        q.mag.assign(a.mag.size(), 0);
+        for (size_t i = n; i-- > 0;) {
+            mul_add_small(r.mag, 2, (a.mag[i / 32] >> (i % 32)) & 1);
+            if (compare_mag(r.mag, b.mag) >= 0) {
+                r.mag = sub_mag(r.mag, b.mag);
+                while (!r.mag.empty() && r.mag.back() == 0) r.mag.pop_back();
+                q.mag[i / 32] |= uint32_t(1) << (i % 32);
+            }
+        }
+    }
+    q.negative = a.negative != b.negative;
+    r.negative = a.negative;
+    q.trim();
+    r.trim();
+}
+
+BigInt BigInt::operator-() const
+{
+    BigInt r = *this;
+    if (!r.mag.empty()) r.negative = !r.negative;
+    return r;
+}
+
+BigInt operator+(const BigInt& a, const BigInt& b)
+{
+    BigInt r;
+    if (a.negative == b.negative) {
+        r.mag = add_mag(a.mag, b.mag);
+        r.negative = a.negative;
+    } else if (compare_mag(a.mag, b.mag) >= 0) {
+        r.mag = sub_mag(a.mag, b.mag);
+        r.negative = a.negative;
+    } else {
+        r.mag = sub_mag(b.mag, a.mag);
+        r.negative = b.negative;
+    }
+    r.trim();
+    return r;
+}
+
+BigInt operator-(const BigInt& a, const BigInt& b)
+{
+    return a + -b;
+}
+
+BigInt operator*(const BigInt& a, const BigInt& b)
+{
+    BigInt r;
+    r.mag = mul_mag(a.mag, b.mag);
+    r.negative = a.negative != b.negative;
+    r.trim();
+    return r;
+}
+
+}; // namespace squirrel
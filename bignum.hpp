@@ -0,0 +1,49 @@
+#ifndef INCLUDED_SQUIRREL_BIGNUM_HPP
+#define INCLUDED_SQUIRREL_BIGNUM_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+namespace squirrel {
+
+// Arbitrary-precision integer, for integer results that don't fit in 64
+// bits. Sign and magnitude; the magnitude is base 2^32, least significant
+// digit first, with no leading zero digits, so zero is empty.
+struct BigInt {
+    bool negative = false;
+    std::vector<uint32_t> mag;
+
+    BigInt() {}
+    BigInt(int64_t v);
+
+    // Decimal digits with an optional leading sign
+    static BigInt parse(const char *s, int len);
+    // Integer part of a finite double
+    static BigInt from_double(double d);
+
+    bool is_zero() const { return mag.empty(); }
+    bool fits_int64() const;
+    // Low 64 bits, two's complement
+    int64_t to_int64() const;
+    double to_double() const;
+    std::string to_string() const;
+    size_t bits() const;
+
+    static int compare(const BigInt& a, const BigInt& b);
+    // Truncating division, like C: the remainder has the sign of a.
+    // b must not be zero.
+    static void divmod(const BigInt& a, const BigInt& b, BigInt& q, BigInt& r);
+
+    BigInt operator-() const;
+    friend BigInt operator+(const BigInt& a, const BigInt& b);
+    friend BigInt operator-(const BigInt& a, const BigInt& b);
+    friend BigInt operator*(const BigInt& a, const BigInt& b);
+
+private:
+    void trim();
+};
+
+}; // namespace squirrel
+
+#endif
@@ -0,0 +1,76 @@
+#include "budget.hpp"
+#include <algorithm>
+
+namespace squirrel {
+
+void Budget::start()
+{
+    reason = StopReason::NONE;
+    limit = fuel;
+    spent = 0;
+    has_deadline = timeout.count() > 0;
+    if (has_deadline) deadline = std::chrono::steady_clock::now() + timeout;
+    batch = limit ? std::min(check_interval, limit) : check_interval;
+    countdown = batch;
+}
+
+void Budget::share(const Budget& from)
+{
+    reason = StopReason::NONE;
+    limit = from.limit ? from.limit - from.used() : 0;
+    spent = 0;
+    has_deadline = from.has_deadline;
+    deadline = from.deadline;
+    cancelled = from.cancelled;
+    batch = limit ? std::min(check_interval, limit) : check_interval;
+    countdown = batch;
+    if (from.reason) {
+        stop(from.reason);
+    } else if (from.limit && limit <= 0) {
+        stop(StopReason::FUEL);
+    }
+}
+
+void Budget::charge(const Budget& worker)
+{
+    spent += worker.used();
+    if (reason) return;
+    if (worker.reason) {
+        stop(worker.reason);
+    } else if (limit && used() >= limit) {
+        stop(StopReason::FUEL);
+    }
+}
+
+void Budget::stop(int why)
+{
+    reason = why;
+    spent = used();
+    batch = 0;
+    countdown = 0;
+}
+
+// The step that found the batch used up is the first of the next one
+bool Budget::refill()
+{
+    if (reason) {
+        countdown = 0;
+        return false;
+    }
+    spent += batch;
+    batch = 0;
+    countdown = 0;
+    if (cancelled->exchange(false, std::memory_order_relaxed)) {
+        stop(StopReason::CANCELLED);
+    } else if (limit && spent >= limit) {
+        stop(StopReason::FUEL);
+    } else if (has_deadline && std::chrono::steady_clock::now() >= deadline) {
+        stop(StopReason::DEADLINE);
+    }
+    if (reason) return false;
+    batch = limit ? std::min(check_interval, limit - spent) : check_interval;
+    countdown = batch - 1;
+    return true;
+}
+
+}; // namespace squirrel
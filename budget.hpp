@@ -0,0 +1,74 @@
+#ifndef INCLUDED_SQUIRREL_BUDGET_HPP
+#define INCLUDED_SQUIRREL_BUDGET_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+
+namespace squirrel {
+
+// Why an evaluation was stopped
+namespace StopReason {
+    enum {
+        NONE,
+        FUEL,
+        DEADLINE,
+        CANCELLED
+    };
+};
+
+// Stops evaluation in the interpreter it came from. Safe to use from any
+// thread, and after the interpreter is gone.
+struct CancelHandle {
+    std::shared_ptr<std::atomic<bool>> flag;
+
+    void cancel() const { flag->store(true, std::memory_order_relaxed); }
+};
+
+// Limits on one top-level evaluation. step() is taken for every form the
+// tree walker evaluates, every call and every trip round a compiled loop;
+// it only counts down, and looks at the clock and the cancel flag once
+// every check_interval steps. Once stopped, every step fails until the next
+// start(), so an evaluation can't carry on by dropping the exception.
+struct Budget {
+    static constexpr int64_t check_interval = 1024;
+
+    // Steps allowed, 0 for no limit
+    int64_t fuel = 0;
+    // Wall-clock time allowed, 0 for no limit
+    std::chrono::nanoseconds timeout{0};
+    int reason = StopReason::NONE;
+
+    void start();
+    // Worker budget for part of what from is evaluating: whatever fuel it
+    // has left, its deadline and its cancel flag
+    void share(const Budget& from);
+    // Takes the steps a worker used, and its reason for stopping
+    void charge(const Budget& worker);
+
+    bool step() { return countdown-- > 0 || refill(); }
+    // For native code, which takes a step by decrementing this and only
+    // calls step() once that goes below zero
+    int64_t *steps_left() { return &countdown; }
+    int64_t used() const { return spent + batch - countdown; }
+
+    // A cancel that comes between evaluations stops the next one
+    CancelHandle handle() const { return CancelHandle{cancelled}; }
+
+private:
+    int64_t countdown = check_interval;
+    int64_t batch = check_interval;
+    int64_t limit = 0;
+    int64_t spent = 0;
+    std::chrono::steady_clock::time_point deadline;
+    bool has_deadline = false;
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+
+    bool refill();
+    void stop(int why);
+};
+
+}; // namespace squirrel
+
+#endif
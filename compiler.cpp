@@ -0,0 +1,534 @@
+#include "compiler.hpp"
+#include "interpreter.hpp"
+
+namespace squirrel {
+
+static const char *op_names[] = {
+    "CONST",
+    "LOAD",
+    "LOAD_LOCAL",
+    "LOAD_GLOBAL",
+    "RESOLVE",
+    "CALL",
+    "TAIL_CALL",
+    "EVAL",
+    "POP",
+    "RETURN",
+    "JUMP",
+    "JUMP_IF_NOT",
+    "JUMP_IF_EXC",
+    "CHECK_VALUE",
+    "NIP",
+    "FOR_PREP",
+    "FOR_NEXT",
+    "EACH_PREP",
+    "EACH_NEXT"
+};
+
+void Code::print(std::ostream& os) const
+{
+    for (int i=0; i<ops.size(); i++) {
+        const Instr& in(ops[i]);
+        os << i << ": " << op_names[in.op] << ' ' << in.a << ' ' << in.b;
+        if (in.op == Op::LOAD_LOCAL || in.op == Op::LOAD_GLOBAL || in.op == Op::FOR_NEXT || in.op == Op::EACH_NEXT) {
+            os << " ; " << consts[in.b];
+        } else if (in.op <= Op::EVAL) {
+            os << " ; " << consts[in.a];
+        }
+        os << std::endl;
+    }
+}
+
+int Compiler::add_const(ValuePtr v)
+{
+    for (int i=0; i<code->consts.size(); i++) {
+        if (code->consts[i] == v) return i;
+    }
+    code->consts.push_back(v);
+    return code->consts.size() - 1;
+}
+
+int Compiler::add_global(SymbolPtr s)
+{
+    for (int i=0; i<code->globals.size(); i++) {
+        if (code->globals[i].sym == s) return i;
+    }
+    GlobalRef g;
+    g.sym = s;
+    code->globals.push_back(g);
+    return code->globals.size() - 1;
+}
+
+static bool is_context_name(const SymbolPtr& sym)
+{
+    return sym == Symbol::parent_symbol || sym == Symbol::global_symbol || sym == Symbol::class_symbol ||
+        sym == Symbol::object_symbol || sym == Symbol::local_symbol;
+}
+
+static bool uses_context_paths(ValuePtr v)
+{
+    if (!v) return false;
+    if (v->type == Value::SYM) {
+        for (const IndexPtr& ix : *static_pointer_cast<SymbolValue>(v)->sym) {
+            if (is_context_name(ix->sym)) return true;
+        }
+    } else if (v->type == Value::LIST || v->type == Value::INFIX) {
+        ListValuePtr l = static_pointer_cast<ListValue>(v);
+        for (int i=0; i<l->size(); i++) {
+            if (uses_context_paths(l->get(i))) return true;
+        }
+    }
+    return false;
+}
+
+// The symbol named by v if it is a single name that find_owner would look
+// up directly, without an index or any of the special context names
+SymbolPtr Compiler::plain_symbol(ValuePtr v, bool allow_quoted)
+{
+    if (!v || v->type != Value::SYM || (v->quote && !allow_quoted)) return 0;
+    IdentifierPtr id = static_pointer_cast<SymbolValue>(v)->sym;
+    if (!id->has_first() || id->has_next()) return 0;
+    IndexPtr first = id->first();
+    if (first->has_index() || is_context_name(first->sym)) return 0;
+    return first->sym;
+}
+
+// Names a body can bind in its own frame: targets of set, func and class,
+// and loop variables. Bodies of nested definitions run in other frames and
+// are not searched.
+void Compiler::collect_locals(ListValuePtr list)
+{
+    static SymbolPtr set_sym = Symbol::make("set");
+    static SymbolPtr func_sym = Symbol::make("func");
+    static SymbolPtr class_sym = Symbol::make("class");
+    static SymbolPtr for_sym = Symbol::make("for");
+    static SymbolPtr each_sym = Symbol::make("each");
+    
+    SymbolPtr head = plain_symbol(list->get(0), true);
+    if (head && list->size() >= 2 && (head == set_sym || head == func_sym || head == class_sym ||
+        head == for_sym || head == each_sym)) {
+        SymbolPtr target = plain_symbol(list->get(1), true);
+        if (target) code->layout->add(target);
+        if (head == func_sym || head == class_sym) return;
+    }
+    for (int i=0; i<list->size(); i++) {
+        ValuePtr v = list->get(i);
+        if (v && v->type == Value::LIST) collect_locals(static_pointer_cast<ListValue>(v));
+    }
+}
+
+int Compiler::emit(uint8_t op, int32_t a, int32_t b)
+{
+    code->ops.push_back(Instr{op, a, b});
+    return code->ops.size() - 1;
+}
+
+void Compiler::push(int n)
+{
+    depth += n;
+    if (depth > code->max_stack) code->max_stack = depth;
+}
+
+void Compiler::pop(int n)
+{
+    depth -= n;
+}
+
+// Mirrors Interpreter::evaluate, one case per branch
+void Compiler::compile_expr(ValuePtr v)
+{
+    if (!v) {
+        emit(Op::EVAL, add_const(v));
+        push();
+        return;
+    }
+
+    if (!v->quote) {
+        if (v->type == Value::LIST) {
+            ListValuePtr l = static_pointer_cast<ListValue>(v);
+            ValuePtr name = l->get(0);
+            if (!name || name->type == Value::EXCEPTION) {
+                emit(Op::EVAL, add_const(v));
+                push();
+                return;
+            }
+            if (name->type == Value::LIST || name->type == Value::INFIX) {
+                compile_sequence(l);
+                return;
+            }
+            if (name->type == Value::SYM) {
+                compile_call(l);
+                return;
+            }
+        } else if (v->type == Value::INFIX) {
+            compile_infix(static_pointer_cast<InfixValue>(v));
+            return;
+        } else if (v->type == Value::SYM) {
+            SymbolPtr sym = plain_symbol(v);
+            int slot = (sym && code->layout) ? code->layout->find(sym) : -1;
+            if (slot >= 0) {
+                emit(Op::LOAD_LOCAL, slot, add_const(v));
+            } else if (sym) {
+                emit(Op::LOAD_GLOBAL, add_global(sym), add_const(v));
+            } else {
+                emit(Op::LOAD, add_const(v));
+            }
+            push();
+            return;
+        }
+    }
+
+    emit(Op::CONST, add_const(v));
+    push();
+}
+
+// Mirrors Interpreter::evaluate_body: the value of the last item is kept
+void Compiler::compile_sequence(ListValuePtr list)
+{
+    int n = list->size();
+    if (n == 0) {
+        emit(Op::CONST, add_const(0));
+        push();
+        return;
+    }
+    for (int i=0; i<n; i++) {
+        compile_expr(list->get(i));
+        if (i < n-1) {
+            emit(Op::POP);
+            pop();
+        }
+    }
+}
+
+// Compiles the prefix form, so infix costs nothing at run time. Forms that
+// don't parse are evaluated by the tree walker, which reports the error.
+void Compiler::compile_infix(InfixValuePtr node)
+{
+    std::vector<std::pair<SymbolPtr, uint32_t>> guards;
+    ValuePtr e = interp ? interp->infix_expr(node, interp->global, &guards) : 0;
+    if (!e || e->type == Value::EXCEPTION || e == node) {
+        emit(Op::EVAL, add_const(node));
+        push();
+        return;
+    }
+    code->guards.insert(code->guards.end(), guards.begin(), guards.end());
+    compile_expr(e);
+}
+
+// A call whose value is returned as is becomes a TAIL_CALL, including one
+// that jumps straight to the RETURN from a branch of an if
+void Compiler::mark_tail_calls()
+{
+    std::vector<Instr>& ops(code->ops);
+    for (int i=0; i+1<ops.size(); i++) {
+        if (ops[i].op != Op::CALL) continue;
+        const Instr& next(ops[i+1]);
+        if (next.op == Op::RETURN || (next.op == Op::JUMP && ops[next.a].op == Op::RETURN)) ops[i].op = Op::TAIL_CALL;
+    }
+}
+
+// True if sym may be bound in a frame rather than the global dictionary
+// by the time this code reaches it: it has been bound locally before, or
+// it is a param or a set/func/class/for/each target of this body, which
+// need not have run yet
+bool Compiler::binds_locally(const SymbolPtr& sym)
+{
+    return sym->local_binding || (code->layout && code->layout->find(sym) >= 0);
+}
+
+static bool is_literal(const ValuePtr& v)
+{
+    return v && (v->type == Value::INT || v->type == Value::FLOAT || v->type == Value::STR || v->type == Value::BOOL);
+}
+
+// Value of a call to a pure builtin whose arguments are literals or such
+// calls themselves, or null. The head must be bound only globally, and
+// not by this body either; the symbols relied on are added to guards.
+ValuePtr Compiler::fold(ListValuePtr node, std::vector<std::pair<SymbolPtr, uint32_t>>& guards)
+{
+    if (!interp) return 0;
+    SymbolPtr head = plain_symbol(node->get(0));
+    if (!head || binds_locally(head)) return 0;
+    auto e = interp->global->vars.entries.find(head->code);
+    if (e == interp->global->vars.entries.end()) return 0;
+    ValuePtr f = e->second.second;
+    if (!f || f->type != Value::OPER) return 0;
+    OperatorValue *ov = static_cast<OperatorValue *>(f.get());
+    // Forcing a literal lazy argument gives the literal, so those fold too
+    if (!ov->pure || (f->quote && !ov->lazy)) return 0;
+    
+    ListValuePtr args = ListValue::make();
+    for (int i=1; i<node->size(); i++) {
+        ValuePtr a = node->get(i);
+        if (a && !a->quote && a->type == Value::LIST) {
+            a = fold(static_pointer_cast<ListValue>(a), guards);
+            if (!a) return 0;
+        } else if (!is_literal(a)) {
+            return 0;
+        }
+        args->append(a);
+    }
+    
+    ValuePtr r = ov->oper(args, interp->global);
+    if (!is_literal(r)) return 0;
+    guards.push_back({head, head->version});
+    return r;
+}
+
+void Compiler::patch(const std::vector<int>& jumps, int target)
+{
+    for (int j : jumps) {
+        Instr& in(code->ops[j]);
+        if (in.op == Op::JUMP_IF_NOT) {
+            in.b = target;
+        } else {
+            in.a = target;
+        }
+    }
+}
+
+// Body items of a loop from first on, leaving the last one's value on the
+// stack. Exceptions leave through exits with the exception on top.
+void Compiler::compile_loop_body(ListValuePtr node, int first, std::vector<int>& exits)
+{
+    if (first >= node->size()) {
+        emit(Op::CONST, add_const(NoneValue::make()));
+        push();
+        return;
+    }
+    for (int i=first; i<node->size(); i++) {
+        compile_expr(node->get(i));
+        exits.push_back(emit(Op::JUMP_IF_EXC));
+        if (i < node->size()-1) {
+            emit(Op::POP);
+            pop();
+        }
+    }
+}
+
+// if, while, for, each, and/or as jumps in this code, when the head is bound
+// only globally, to the builtin, and this body doesn't rebind it. The
+// builtins define what these do; the code here produces the same values and
+// exceptions, without the builtin call or the evaluate() per item.
+bool Compiler::compile_control(ListValuePtr node)
+{
+    if (!interp) return false;
+    SymbolPtr head = plain_symbol(node->get(0));
+    if (!head || binds_locally(head)) return false;
+    auto e = interp->global->vars.entries.find(head->code);
+    if (e == interp->global->vars.entries.end()) return false;
+    ValuePtr f = e->second.second;
+    if (!f || f->type != Value::OPER) return false;
+    uint8_t control = static_cast<OperatorValue *>(f.get())->control;
+    
+    int n = node->size() - 1;
+    SymbolPtr var = n >= 1 ? plain_symbol(node->get(1), true) : 0;
+    if (control == ControlOp::NONE ||
+        (control == ControlOp::IF && n < 2) ||
+        (control == ControlOp::WHILE && n < 1) ||
+        (control == ControlOp::FOR && (n < 3 || !var)) ||
+        (control == ControlOp::EACH && (n < 2 || !var))) return false;
+    code->guards.push_back({head, head->version});
+    
+    std::vector<int> exits;
+    if (control == ControlOp::AND) {
+        // The first false argument jumps to a false result
+        std::vector<int> falses;
+        for (int i=1; i<=n; i++) {
+            compile_expr(node->get(i));
+            int test = emit(Op::JUMP_IF_NOT);
+            falses.push_back(test);
+            exits.push_back(test);
+            pop();
+        }
+        emit(Op::CONST, add_const(Value::TRUE));
+        exits.push_back(emit(Op::JUMP));
+        for (int j : falses) code->ops[j].a = code->ops.size();
+        emit(Op::CONST, add_const(Value::FALSE));
+        push();
+        patch(exits, code->ops.size());
+        return true;
+    }
+    
+    if (control == ControlOp::OR) {
+        // The first true argument gives a true result
+        for (int i=1; i<=n; i++) {
+            compile_expr(node->get(i));
+            int test = emit(Op::JUMP_IF_NOT);
+            exits.push_back(test);
+            pop();
+            emit(Op::CONST, add_const(Value::TRUE));
+            exits.push_back(emit(Op::JUMP));
+            code->ops[test].a = code->ops.size();
+        }
+        emit(Op::CONST, add_const(Value::FALSE));
+        push();
+        patch(exits, code->ops.size());
+        return true;
+    }
+    
+    if (control == ControlOp::IF) {
+        // Each taken branch and a failed condition jump to the end with one value
+        int i = 1;
+        for (; i+1 <= n; i += 2) {
+            compile_expr(node->get(i));
+            int test = emit(Op::JUMP_IF_NOT);
+            exits.push_back(test);
+            pop();
+            compile_expr(node->get(i+1));
+            exits.push_back(emit(Op::JUMP));
+            pop();
+            code->ops[test].a = code->ops.size();
+        }
+        if (i <= n) {
+            compile_expr(node->get(i));
+        } else {
+            emit(Op::CONST, add_const(NoneValue::make()));
+            push();
+        }
+        patch(exits, code->ops.size());
+        return true;
+    }
+    
+    if (control == ControlOp::WHILE) {
+        // result
+        emit(Op::CONST, add_const(NoneValue::make()));
+        push();
+        int top = code->ops.size();
+        compile_expr(node->get(1));
+        int test = emit(Op::JUMP_IF_NOT);
+        pop();
+        emit(Op::POP);
+        pop();
+        compile_loop_body(node, 2, exits);
+        emit(Op::JUMP, top);
+        // Failed condition: drop the result under the exception
+        code->ops[test].b = code->ops.size();
+        emit(Op::NIP, 1);
+        code->ops[test].a = code->ops.size();
+        patch(exits, code->ops.size());
+        return true;
+    }
+    
+    int k = add_const(node->get(1));
+    std::vector<int> done;
+    if (control == ControlOp::FOR) {
+        compile_expr(node->get(2));
+        done.push_back(emit(Op::CHECK_VALUE));
+        compile_expr(node->get(3));
+        int check_end = emit(Op::CHECK_VALUE);
+        // counter, end, variable's value, result
+        emit(Op::FOR_PREP);
+        push(2);
+        int top = emit(Op::FOR_NEXT, 0, k);
+        exits.push_back(top);
+        emit(Op::POP);
+        pop();
+        compile_loop_body(node, 4, exits);
+        emit(Op::JUMP, top);
+        patch(exits, code->ops.size());
+        emit(Op::NIP, 3);
+        pop(3);
+        done.push_back(emit(Op::JUMP));
+        // Bad end: drop the start under the exception
+        code->ops[check_end].a = code->ops.size();
+        emit(Op::NIP, 1);
+    } else {
+        compile_expr(node->get(2));
+        done.push_back(emit(Op::CHECK_VALUE));
+        done.push_back(emit(Op::EACH_PREP));
+        // list, index, result
+        push(2);
+        int top = emit(Op::EACH_NEXT, 0, k);
+        exits.push_back(top);
+        emit(Op::POP);
+        pop();
+        compile_loop_body(node, 3, exits);
+        emit(Op::JUMP, top);
+        patch(exits, code->ops.size());
+        emit(Op::NIP, 2);
+        pop(2);
+    }
+    patch(done, code->ops.size());
+    return true;
+}
+
+void Compiler::compile_call(ListValuePtr node)
+{
+    std::vector<std::pair<SymbolPtr, uint32_t>> guards;
+    ValuePtr folded = fold(node, guards);
+    if (folded) {
+        code->guards.insert(code->guards.end(), guards.begin(), guards.end());
+        emit(Op::CONST, add_const(folded));
+        push();
+        return;
+    }
+    if (compile_control(node)) return;
+    
+    // Left to the tree walker, which evaluates the arguments in parallel
+    if (interp && interp->parallel_threads && interp->parallel_candidate(node.get())) {
+        emit(Op::EVAL, add_const(node));
+        push();
+        return;
+    }
+    
+    int k = add_const(node);
+    int resolve = emit(Op::RESOLVE, k);
+    int argc = node->size() - 1;
+    for (int i=1; i<=argc; i++) {
+        compile_expr(node->get(i));
+    }
+    emit(Op::CALL, k, argc);
+    pop(argc);
+    push();
+    code->ops[resolve].b = code->ops.size();
+}
+
+CodePtr Compiler::compile_body(ListValuePtr body, Interpreter *interp)
+{
+    if (!body) return 0;
+    Compiler comp;
+    comp.interp = interp;
+    comp.code = Code::make();
+    comp.compile_sequence(body);
+    comp.emit(Op::RETURN);
+    return comp.code;
+}
+
+// Like compile_body, but params and names the body sets get frame slots.
+// Frames are dynamically scoped, so the function's own frame is the only
+// one whose layout is known here; other names go through the global cache
+// or the ordinary lookup.
+CodePtr Compiler::compile_function(FunctionValuePtr fv, Interpreter *interp)
+{
+    if (!fv->body) return 0;
+    Compiler comp;
+    comp.interp = interp;
+    comp.code = Code::make();
+    comp.code->layout = SlotLayout::make();
+    if (fv->params) {
+        for (int i=0; i<fv->params->size(); i++) {
+            SymbolPtr sym = plain_symbol(fv->params->get(i), true);
+            if (sym) comp.code->layout->add(sym);
+        }
+    }
+    comp.collect_locals(fv->body);
+    comp.code->uses_context_paths = uses_context_paths(fv->body);
+    comp.compile_sequence(fv->body);
+    comp.emit(Op::RETURN);
+    comp.mark_tail_calls();
+    return comp.code;
+}
+
+CodePtr Compiler::compile_form(ValuePtr form, Interpreter *interp)
+{
+    if (!form) return 0;
+    Compiler comp;
+    comp.interp = interp;
+    comp.code = Code::make();
+    comp.compile_expr(form);
+    comp.emit(Op::RETURN);
+    return comp.code;
+}
+
+}; // namespace squirrel
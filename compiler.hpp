@@ -0,0 +1,107 @@
+#ifndef INCLUDED_SQUIRREL_COMPILER_HPP
+#define INCLUDED_SQUIRREL_COMPILER_HPP
+
+#include "value.hpp"
+#include "dictionary.hpp"
+
+namespace squirrel {
+
+namespace Op {
+    enum {
+        CONST,      // push consts[a]
+        LOAD,       // push value of symbol consts[a]
+        LOAD_LOCAL, // push frame slot a, or the value of symbol consts[b] if it is unbound
+        LOAD_GLOBAL,// push global binding globals[a], or the value of symbol consts[b] if shadowed
+        RESOLVE,    // look up head of call node consts[a]; for no-eval callees, call now and jump to b
+        CALL,       // call the resolved head of consts[a] with b evaluated args from the stack
+        TAIL_CALL,  // CALL followed by RETURN; may replace the current frame with the callee's
+        EVAL,       // tree-walk consts[a] and push the result
+        POP,        // discard top of stack
+        RETURN,     // return top of stack
+        JUMP,       // continue at a
+        JUMP_IF_NOT,// pop; continue at a if false, or push the exception and continue at b
+        JUMP_IF_EXC,// continue at a if top of stack is an exception
+        CHECK_VALUE,// continue at a if top of stack is an exception, or null (replaced by one)
+        NIP,        // drop the a values under top of stack
+        FOR_PREP,   // start, end -> counter, end, variable's value, result
+        FOR_NEXT,   // continue at a when the counter reaches the end, else bind symbol consts[b] and count
+        EACH_PREP,  // list -> list, index, result; continue at a with an exception if not a list
+        EACH_NEXT   // continue at a at the end of the list, else bind symbol consts[b] to the next item
+    };
+};
+
+struct Instr {
+    uint8_t op;
+    int32_t a;
+    int32_t b;
+};
+
+// A free name that no frame has ever bound can only resolve to the global
+// dictionary. The value is cached until the symbol's version changes.
+struct GlobalRef {
+    SymbolPtr sym;
+    uint32_t version = 0;
+    ValuePtr value;
+};
+
+// Compiled form of a function body or top-level form
+struct Code : public RefCounted {
+    std::vector<Instr> ops;
+    std::vector<ValuePtr> consts;
+    std::vector<GlobalRef> globals;
+    // Frame layout for function bodies; frames created for this code use it
+    SlotLayoutPtr layout;
+    // Body names parent/global/class/object/local, so its frame's ancestry
+    // is observable and a tail call into it must not collapse frames
+    bool uses_context_paths = false;
+    // Operator symbols that infix forms were parsed with or calls were folded by
+    std::vector<std::pair<SymbolPtr, uint32_t>> guards;
+    int max_stack = 0;
+
+    Code() { set_gc_kind(GcKind::CODE); }
+    static CodePtr make() { return make_ref<Code>(); }
+    
+    bool stale() const {
+        for (const auto& g : guards) {
+            if (g.first->version != g.second) return true;
+        }
+        return false;
+    }
+
+    void print(std::ostream& os) const;
+};
+
+struct Compiler {
+    CodePtr code;
+    // Used to parse infix forms; without it they are left to the tree walker
+    Interpreter *interp = 0;
+    int depth = 0;
+
+    static CodePtr compile_body(ListValuePtr body, Interpreter *interp = 0);
+    static CodePtr compile_function(FunctionValuePtr fv, Interpreter *interp = 0);
+    static CodePtr compile_form(ValuePtr form, Interpreter *interp = 0);
+    static SymbolPtr plain_symbol(ValuePtr v, bool allow_quoted = false);
+
+private:
+    int add_const(ValuePtr v);
+    int add_global(SymbolPtr s);
+    void collect_locals(ListValuePtr list);
+    bool binds_locally(const SymbolPtr& sym);
+    void mark_tail_calls();
+    int emit(uint8_t op, int32_t a = 0, int32_t b = 0);
+    void push(int n = 1);
+    void pop(int n = 1);
+
+    void compile_expr(ValuePtr v);
+    void compile_sequence(ListValuePtr list);
+    void compile_call(ListValuePtr node);
+    bool compile_control(ListValuePtr node);
+    void compile_loop_body(ListValuePtr node, int first, std::vector<int>& exits);
+    void patch(const std::vector<int>& jumps, int target);
+    void compile_infix(InfixValuePtr node);
+    ValuePtr fold(ListValuePtr node, std::vector<std::pair<SymbolPtr, uint32_t>>& guards);
+};
+
+}; // namespace squirrel
+
+#endif
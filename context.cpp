@@ -1,6 +1,7 @@
 #include "context.hpp"
 #include "value.hpp"
 #include "interpreter.hpp"
+#include <sstream>
 
 namespace squirrel {
 
@@ -11,10 +12,38 @@ ValuePtr wrap_exception(ValuePtr v, ContextPtr c)
 }
 
 
+// An exception passing out of a frame has it added to its trace, rather
+// than being wrapped in a new exception per frame. One kept and raised
+// again carries on from where it got to. Under a try that throws the
+// exception away, nothing is recorded.
+ValuePtr Context::wrap_exception(ValuePtr e)
+{
+    if (e->type != Value::EXCEPTION || (interp && interp->untraced)) return e;
+    ExceptionValue *ev = static_cast<ExceptionValue *>(e.get());
+    if (ev->last_frame().get() == this) return e;
+    ev->trace.push_back(shared_from_this());
+    return e;
+}
+
+ContextPtr Context::make_function_context(SymbolPtr name)
+{
+    return adopt(interp->frames.make(interp), Symbol::func_symbol, name);
+}
+
+void Context::operator delete(Context *c, std::destroying_delete_t)
+{
+    if (c->arena) {
+        c->arena->release(c);
+    } else {
+        c->~Context();
+        operator delete(c, sizeof(Context));
+    }
+}
+
 ValuePtr Context::set(IndexPtr s, ValuePtr t, ContextPtr caller) {
     if (s->has_index()) {
         ListValuePtr list = CAST_LIST(get(s->sym), shared_from_this());
-        list->put(interp->evaluate(s->index, caller)->as_int(), t);
+        list->put(interp->evaluate(s->index, caller).as_int(), t);
     } else {
         return set(s->sym, t);
     }
@@ -24,7 +53,7 @@ ValuePtr Context::set(IndexPtr s, ValuePtr t, ContextPtr caller) {
 ValuePtr Context::get(IndexPtr s, ContextPtr caller) {
     if (s->has_index()) {
         ListValuePtr list = CAST_LIST(get(s->sym), shared_from_this());
-        return list->get(interp->evaluate(s->index, caller)->as_int());
+        return list->get(interp->evaluate(s->index, caller).as_int());
     } else {
         return get(s->sym);
     }
@@ -73,17 +102,45 @@ ValuePtr Context::find_ancestor_type(SymbolPtr sym)
     return ExceptionValue::make(std::string("No ancestor of type ") + sym->as_string(), shared_from_this());
 }
 
+// Dotted paths are walked by offset into the original identifier rather
+// than through Identifier::next(), which allocates at every step.
+static void print_path(std::ostream& os, const IdentifierPtr& s, int off)
+{
+    for (int i=off; i<s->syms.size(); i++) {
+        if (i > off) os << '.';
+        os << s->syms[i];
+    }
+}
+
+static std::string path_string(const IdentifierPtr& s, int off)
+{
+    std::stringstream ss;
+    print_path(ss, s, off);
+    return ss.str();
+}
+
+ValuePtr Context::find_owner(IdentifierPtr s, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing)
+{
+    return find_owner(s->original(), s->offset, caller, exec_context, func_context, for_writing);
+}
+
 ValuePtr Context::find_owner_local(IdentifierPtr s, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing)
 {
-    if (!s->has_first()) return ExceptionValue::make(std::string("Invalid identifier: ") + s->original()->as_string(), shared_from_this());
-    IndexPtr first = s->first();
+    return find_owner_local(s->original(), s->offset, caller, exec_context, func_context, for_writing);
+}
+
+ValuePtr Context::find_owner_local(const IdentifierPtr& s, int off, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing)
+{
+    if (off >= s->syms.size()) return ExceptionValue::make("Invalid identifier: ", s, shared_from_this());
+    const IndexPtr& first = s->syms[off];
+    bool has_next = off+1 < s->syms.size();
 
     if (!vars.has_key(first->sym)) {
-        if (first->has_index()) ExceptionValue::make(std::string("No such identifier: ") + s->original()->as_string(), shared_from_this());
+        if (first->has_index()) ExceptionValue::make("No such identifier: ", s, shared_from_this());
         if (for_writing) {
-            if (s->has_next()) {
+            if (has_next) {
                 // The variable doesn't exist, but we have more symbols?
-                return ExceptionValue::make(std::string("No such identifier: ") + s->original()->as_string(), shared_from_this());
+                return ExceptionValue::make("No such identifier: ", s, shared_from_this());
             }
             exec_context = shared_from_this();
             func_context = shared_from_this();
@@ -99,10 +156,10 @@ ValuePtr Context::find_owner_local(IdentifierPtr s, ContextPtr caller, ContextPt
                 }
             }
         }
-        return ExceptionValue::make(std::string("No such identifier: ") + s->original()->as_string(), shared_from_this());
+        return ExceptionValue::make("No such identifier: ", s, shared_from_this());
     } else {
         // If there are no more symbols, we've found the context
-        if (!s->has_next()) {
+        if (!has_next) {
             exec_context = shared_from_this();
             func_context = shared_from_this();
             return NoneValue::make();
@@ -110,19 +167,22 @@ ValuePtr Context::find_owner_local(IdentifierPtr s, ContextPtr caller, ContextPt
         }
         // Otherwise make sure the current name is a context
         ValuePtr v = vars.get(first->sym);
-        if (v->type == Value::LIST && first->has_index()) v = CAST_LIST(v, 0)->get(interp->evaluate(first->index, caller)->as_int());
+        if (v->type == Value::LIST && first->has_index()) v = CAST_LIST(v, 0)->get(interp->evaluate(first->index, caller).as_int());
         if (v->has_context()) {
-            return v->get_context()->find_owner_local(s->next(), caller, exec_context, func_context, for_writing);
+            return v->get_context()->find_owner_local(s, off+1, caller, exec_context, func_context, for_writing);
         }
-        return ExceptionValue::make(std::string("Not a context: ") + s->as_string(), shared_from_this());
+        return ExceptionValue::make(std::string("Not a context: ") + path_string(s, off), shared_from_this());
     }
 }
 
-ValuePtr Context::find_owner(IdentifierPtr s, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing)
+ValuePtr Context::find_owner(const IdentifierPtr& s, int off, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing)
 {
-    std::cout << "Looking for " << s << " in " << get_name() << " writing=" << for_writing << std::endl;
-    if (!s->has_first()) ExceptionValue::make(std::string("Invalid identifier: ") + s->original()->as_string(), shared_from_this());
-    IndexPtr first = s->first();
+    std::cout << "Looking for ";
+    print_path(std::cout, s, off);
+    std::cout << " in " << get_name() << " writing=" << for_writing << std::endl;
+    if (off >= s->syms.size()) ExceptionValue::make("Invalid identifier: ", s, shared_from_this());
+    const IndexPtr& first = s->syms[off];
+    bool has_next = off+1 < s->syms.size();
     
     if (first->sym == Symbol::parent_symbol) {
         // Parent of global is itself
@@ -132,21 +192,21 @@ ValuePtr Context::find_owner(IdentifierPtr s, ContextPtr caller, ContextPtr& exe
             return NoneValue::make();
             // return ContextValue::make(shared_from_this());
         }
-        return parent->find_owner(s->next(), caller, exec_context, func_context, for_writing);
-    } else if (s->has_next() && (first->sym == Symbol::global_symbol || first->sym == Symbol::class_symbol || first->sym == Symbol::object_symbol)) {
+        return parent->find_owner(s, off+1, caller, exec_context, func_context, for_writing);
+    } else if (has_next && (first->sym == Symbol::global_symbol || first->sym == Symbol::class_symbol || first->sym == Symbol::object_symbol)) {
         ValuePtr v = NULL_EXCEPTION(CHECK_EXCEPTION(find_ancestor_type(first->sym)), shared_from_this());
-        if (v->has_context()) return v->get_context()->find_owner(s->next(), caller, exec_context, func_context, for_writing);
-        return ExceptionValue::make(std::string("Not a context: ") + s->as_string(), shared_from_this());
+        if (v->has_context()) return v->get_context()->find_owner(s, off+1, caller, exec_context, func_context, for_writing);
+        return ExceptionValue::make(std::string("Not a context: ") + path_string(s, off), shared_from_this());
     } else if (first->sym == Symbol::local_symbol) {
-        return find_owner_local(s->next(), caller, exec_context, func_context, for_writing);
+        return find_owner_local(s, off+1, caller, exec_context, func_context, for_writing);
     } else {
         if (!vars.has_key(first->sym)) {
             std::cout << "No has key " << first->sym << std::endl;
-            if (first->has_index()) ExceptionValue::make(std::string("No such identifier: ") + s->original()->as_string(), shared_from_this());
+            if (first->has_index()) ExceptionValue::make("No such identifier: ", s, shared_from_this());
             if (for_writing) {
-                if (s->has_next()) {
+                if (has_next) {
                     // The variable doesn't exist, but we have more symbols?
-                    return ExceptionValue::make(std::string("No such identifier: ") + s->original()->as_string(), shared_from_this());
+                    return ExceptionValue::make("No such identifier: ", s, shared_from_this());
                 }
                 // Symbol not found, but we're writing, return current context
                 exec_context = shared_from_this();
@@ -165,14 +225,14 @@ ValuePtr Context::find_owner(IdentifierPtr s, ContextPtr caller, ContextPtr& exe
             }
             // For reading, we can search upwards in scope
             if (!parent) {
-                return ExceptionValue::make(std::string("No such identifier: ") + s->original()->as_string(), shared_from_this());
+                return ExceptionValue::make("No such identifier: ", s, shared_from_this());
             }
-            return parent->find_owner(s, caller, exec_context, func_context, false);
+            return parent->find_owner(s, off, caller, exec_context, func_context, false);
         } else {
             std::cout << "Has key " << first->sym << std::endl;
             // If we have the key, then we've found the variable
             // If there are no more symbols, then we're done
-            if (!s->has_next()) {
+            if (!has_next) {
                 exec_context = shared_from_this();
                 func_context = shared_from_this();
                 return NoneValue::make();
@@ -181,11 +241,11 @@ ValuePtr Context::find_owner(IdentifierPtr s, ContextPtr caller, ContextPtr& exe
             // Otherwise make sure the variable found if a context and ask it for the next symbol
             ValuePtr v = vars.get(first->sym);
             std::cout << "Checking for index\n";
-            if (v->type == Value::LIST && first->has_index()) v = CAST_LIST(v, 0)->get(interp->evaluate(first->index, caller)->as_int());
+            if (v->type == Value::LIST && first->has_index()) v = CAST_LIST(v, 0)->get(interp->evaluate(first->index, caller).as_int());
             if (v->has_context()) {
-                return v->get_context()->find_owner(s->next(), caller, exec_context, func_context, for_writing);
+                return v->get_context()->find_owner(s, off+1, caller, exec_context, func_context, for_writing);
             }
-            return ExceptionValue::make(std::string("Not a context: ") + s->as_string(), shared_from_this());
+            return ExceptionValue::make(std::string("Not a context: ") + path_string(s, off), shared_from_this());
         }
     }
 }
@@ -194,9 +254,9 @@ void Context::print(std::ostream& os) const
 {
     if (name) os << ' ' << name;
     if (parent) os << " parent=" << parent->name;
-    for (const auto& v : vars.entries) {
-        os << ' ' << v.second.first << '=' << v.second.second;
-    }
+    vars.for_each([&os](const SymbolPtr& s, const ValuePtr& v) {
+        os << ' ' << s << '=' << v;
+    });
 }
 
 
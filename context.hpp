@@ -5,22 +5,36 @@
 #include "symbol.hpp"
 #include "value.hpp"
 #include "dictionary.hpp"
+#include <new>
 
 namespace squirrel {
 
-struct Context : public std::enable_shared_from_this<Context> {
-    Interpreter *interp;
+struct FrameArena;
+
+struct Context : public RefCounted {
+    Interpreter *interp = 0;
+    // Where the frame goes back to once nothing refers to it, if it came
+    // from a FrameArena
+    FrameArena *arena = 0;
     ContextPtr parent;
     Dictionary vars;
     SymbolPtr name;
     SymbolPtr type;
     int stack_depth = 0;
     
+    Context() { set_gc_kind(GcKind::CONTEXT); }
+    
     void print(std::ostream& os) const;
     
+    ContextPtr shared_from_this() { return ContextPtr(this); }
+    DEF_SLAB(Context, SlabKind::CONTEXT)
+    void operator delete(Context *c, std::destroying_delete_t);
+    
     ValuePtr find_ancestor_type(SymbolPtr sym);
     ValuePtr find_owner(IdentifierPtr s, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing = false);
     ValuePtr find_owner_local(IdentifierPtr s, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing = false);
+    ValuePtr find_owner(const IdentifierPtr& s, int off, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing);
+    ValuePtr find_owner_local(const IdentifierPtr& s, int off, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, bool for_writing);
     
     ValuePtr set(IdentifierPtr s, ValuePtr t, ContextPtr caller);
     ValuePtr get(IdentifierPtr s, ContextPtr caller);
@@ -48,7 +62,7 @@ struct Context : public std::enable_shared_from_this<Context> {
     ValuePtr set(ValuePtr s, ValuePtr t, ContextPtr caller) { return set(CAST_SYMBOL(s, shared_from_this())->sym, t, caller); }
         
     static ContextPtr make(Interpreter *i) { 
-        ContextPtr c = std::make_shared<Context>(); 
+        ContextPtr c = make_ref<Context>(); 
         c->interp = i;
         return c;
     }
@@ -56,22 +70,16 @@ struct Context : public std::enable_shared_from_this<Context> {
         ContextPtr c = make(i);
         c->type = Symbol::global_symbol;
         c->name = Symbol::global_symbol;
+        c->vars.global = true;
         return c;
     }
     
     ContextPtr make_child_context(SymbolPtr type, SymbolPtr name) {
-        ContextPtr c = make(interp);
-        c->stack_depth = stack_depth+1;
-        c->parent = shared_from_this();
-        c->type = type;
-        c->name = name;
-        //if (name) set(name, ContextValue::make(c));
-        return c;
+        return adopt(make(interp), type, name);
     }
     
-    ContextPtr make_function_context(SymbolPtr name) { 
-        return make_child_context(Symbol::func_symbol, name);
-    }
+    // Function frames come from the interpreter's FrameArena
+    ContextPtr make_function_context(SymbolPtr name);
     ContextPtr make_class_context(SymbolPtr name) { 
         ContextPtr c = make_child_context(Symbol::class_symbol, name); 
         set(name, ClassValue::make(c));
@@ -81,26 +89,24 @@ struct Context : public std::enable_shared_from_this<Context> {
         return make_child_context(Symbol::object_symbol, name); 
     }
     
-    ValuePtr wrap_exception(ValuePtr e) {
-        if (e->type == Value::EXCEPTION) {
-            ExceptionValuePtr ev = CAST_EXCEPTION(e, 0);
-            auto self = shared_from_this();
-            if (ev->context == self) return e;
-            
-            ExceptionValuePtr new_ev = ExceptionValue::make();
-            //std::cout << "Wrapping exception: " << ValuePtr(ev) << std::endl;
-            new_ev->context = self;
-            new_ev->parent = ev;
-            return new_ev;
-        } else {
-            return e;
-        }
-    }
+    // Records this frame on the way out of an exception, see context.cpp
+    ValuePtr wrap_exception(ValuePtr e);
     
     SymbolPtr get_name() {
         if (!name) return type;
         return name;
     }
+
+private:
+    // Makes c a child of this context
+    ContextPtr adopt(ContextPtr c, SymbolPtr type, SymbolPtr name) {
+        c->stack_depth = stack_depth+1;
+        c->parent = shared_from_this();
+        c->type = type;
+        c->name = name;
+        //if (name) set(name, ContextValue::make(c));
+        return c;
+    }
 };
 
 } // namespace squirrel
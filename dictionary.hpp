@@ -2,22 +2,113 @@
 #define INCLUDED_SQUIRREL_DICTIONARY_HPP
 
 #include "value.hpp"
+#include <unordered_map>
 
 namespace squirrel {
 
+// Names a compiled function body binds in its own frame, in slot order.
+// Every get and set on the frame looks its name up here, so names are also
+// hashed by symbol code into index, which holds slot+1 or 0 for empty.
+struct SlotLayout : public RefCounted {
+    std::vector<SymbolPtr> names;
+    std::vector<int> index;
+    
+    static SlotLayoutPtr make() { return make_ref<SlotLayout>(); }
+    
+    int find(const SymbolPtr& s) const {
+        if (index.empty()) return -1;
+        size_t mask = index.size() - 1;
+        for (size_t h = s->code & mask;; h = (h + 1) & mask) {
+            int i = index[h] - 1;
+            if (i < 0 || names[i]->code == s->code) return i;
+        }
+    }
+    
+    int add(const SymbolPtr& s) {
+        int i = find(s);
+        if (i >= 0) return i;
+        names.push_back(s);
+        // At most half full, so that probes stay short and end
+        if (names.size() * 2 > index.size()) {
+            index.assign(std::max<size_t>(8, index.size() * 2), 0);
+            for (int j=0; j<names.size(); j++) insert(j);
+        } else {
+            insert(names.size() - 1);
+        }
+        return names.size() - 1;
+    }
+
+private:
+    void insert(int i) {
+        size_t mask = index.size() - 1;
+        size_t h = names[i]->code & mask;
+        while (index[h]) h = (h + 1) & mask;
+        index[h] = i + 1;
+    }
+};
+
 struct Dictionary {
     std::unordered_map<int, std::pair<SymbolPtr, ValuePtr>> entries;
+    bool global = false;
+    
+    // Optional dense storage for the names in layout; a null slot is unbound.
+    // Bindings to null values stay in entries so that they still count.
+    SlotLayoutPtr layout;
+    std::vector<ValuePtr> slots;
+    
+    void use_layout(SlotLayoutPtr l) {
+        layout = l;
+        slots.resize(l->names.size());
+    }
+    
+    int slot_of(const SymbolPtr& s) const {
+        return layout ? layout->find(s) : -1;
+    }
     
     void set(SymbolPtr s, ValuePtr t) {
         std::cout << "Setting " << s << " to " << t << std::endl;
+        s->bump(global);
+        int i = slot_of(s);
+        if (i >= 0) {
+            slots[i] = t;
+            if (t) {
+                if (!entries.empty()) entries.erase(s->code);
+                return;
+            }
+        }
         entries[s->code] = {s, t};
     }
+
+    // set() for layout->names[i], without the search or the message
+    void set_slot(int i, ValuePtr t) {
+        const SymbolPtr& s = layout->names[i];
+        if (!t) return set(s, t);
+        s->bump(global);
+        slots[i] = std::move(t);
+        if (!entries.empty()) entries.erase(s->code);
+    }
+
+    // Empty, without a layout, keeping the storage for reuse
+    void clear() {
+        entries.clear();
+        slots.clear();
+        layout.reset();
+        global = false;
+    }
     
     void unset(SymbolPtr s) {
+        s->bump(true);
+        int i = slot_of(s);
+        if (i >= 0) slots[i].reset();
         entries.erase(s->code);
     }
     
     ValuePtr get(SymbolPtr s) {
+        int j = slot_of(s);
+        if (j >= 0 && slots[j]) {
+            std::cout << "Getting " << s << " as " << slots[j] << std::endl;
+            return slots[j];
+        }
         auto i = entries.find(s->code);
         if (i == entries.end()) {
             std::cout << "Variable " << s << " not found\n";
@@ -28,12 +119,49 @@ struct Dictionary {
         return r;
     }
     
+    // Binding of s or null, without the messages get() prints
+    ValuePtr lookup(const SymbolPtr& s) const {
+        int j = slot_of(s);
+        if (j >= 0 && slots[j]) return slots[j];
+        auto i = entries.find(s->code);
+        return i == entries.end() ? 0 : i->second.second;
+    }
+    
+    // Where s is bound, or null, for changing the binding in place
+    ValuePtr *binding(const SymbolPtr& s) {
+        int j = slot_of(s);
+        if (j >= 0 && slots[j]) return &slots[j];
+        auto i = entries.find(s->code);
+        return i == entries.end() ? 0 : &i->second.second;
+    }
+    
     bool has_key(SymbolPtr s) {
+        int i = slot_of(s);
+        if (i >= 0 && slots[i]) return true;
         return entries.find(s->code) != entries.end();
     }
+    
+    // Start out with a copy of another dictionary's bindings
+    void inherit(const Dictionary& other) {
+        if (layout == other.layout) {
+            slots = other.slots;
+            entries = other.entries;
+        } else {
+            other.for_each([this](const SymbolPtr& s, const ValuePtr& v) { set(s, v); });
+        }
+    }
+    
+    template <typename F>
+    void for_each(F f) const {
+        if (layout) {
+            for (int i=0; i<slots.size(); i++) {
+                if (slots[i]) f(layout->names[i], slots[i]);
+            }
+        }
+        for (const auto& v : entries) f(v.second.first, v.second.second);
+    }
 };
 
-typedef std::shared_ptr<Dictionary> DictionaryPtr;
 
 } // namespace squirrel
 
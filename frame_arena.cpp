@@ -0,0 +1,54 @@
+#include "frame_arena.hpp"
+#include "interpreter.hpp"
+#include <new>
+
+namespace squirrel {
+
+ContextPtr FrameArena::make(Interpreter *interp)
+{
+    if (heap_only) return Context::make(interp);
+    Context *c;
+    if (!free_frames.empty()) {
+        c = free_frames.back();
+        free_frames.pop_back();
+        stats.reused++;
+    } else {
+        if (chunk_used == chunk_frames) {
+            chunks.push_back(::operator new(sizeof(Context) * chunk_frames));
+            chunk_used = 0;
+        }
+        c = ::new (static_cast<Context *>(chunks.back()) + chunk_used++) Context;
+        c->arena = this;
+        stats.allocated++;
+    }
+    c->interp = interp;
+    return ContextPtr(c);
+}
+
+// Back to how Context's constructor leaves it, except for storage the
+// dictionary keeps for the next frame
+void FrameArena::release(Context *c)
+{
+    c->detach_weak();
+    c->detach_gc();
+    c->parent.reset();
+    c->name.reset();
+    c->type.reset();
+    c->stack_depth = 0;
+    c->vars.clear();
+    free_frames.push_back(c);
+}
+
+FrameArena::~FrameArena()
+{
+    for (Context *c : free_frames) c->~Context();
+
+    // Frames still in use are held from outside the interpreter, or by
+    // cycles the collector didn't get to; their chunks are left to them
+    size_t made = chunks.empty() ? 0 : (chunks.size() - 1) * chunk_frames + chunk_used;
+    if (free_frames.size() == made) {
+        for (void *p : chunks) ::operator delete(p);
+    }
+}
+
+}; // namespace squirrel
@@ -0,0 +1,51 @@
+#ifndef INCLUDED_SQUIRREL_FRAME_ARENA_HPP
+#define INCLUDED_SQUIRREL_FRAME_ARENA_HPP
+
+#include "types.hpp"
+#include <vector>
+#include <cstddef>
+
+namespace squirrel {
+
+struct FrameStats {
+    uint64_t allocated = 0;     // frames carved out of a chunk
+    uint64_t reused = 0;        // frames taken back off the free list
+
+    void reset() { *this = FrameStats(); }
+};
+
+// Function frames for one interpreter. Contexts are carved out of chunks
+// and handed out with their arena set, so that when the last reference goes
+// they are given back here instead of deleted (see Context's operator
+// delete). A frame nothing else holds on to is recycled as soon as its call
+// returns, keeping the storage its dictionary grew. A frame that escapes the
+// call, through a ContextValue, an exception or a nested class, just stays
+// live for as long as those keep it.
+// Frames must not outlive the interpreter, which their interp pointer
+// already requires.
+struct FrameArena {
+    static constexpr int chunk_frames = 64;
+
+    FrameStats stats;
+    // Make every frame on the heap instead, for interpreters whose frames
+    // may be dropped on another thread
+    bool heap_only = false;
+
+    FrameArena() {}
+    FrameArena(const FrameArena&) = delete;
+    ~FrameArena();
+
+    ContextPtr make(Interpreter *interp);
+
+    // Takes back a frame from make() that nothing refers to
+    void release(Context *c);
+
+private:
+    std::vector<void *> chunks;
+    int chunk_used = chunk_frames;
+    std::vector<Context *> free_frames;
+};
+
+}; // namespace squirrel
+
+#endif
@@ -0,0 +1,424 @@
+#include "gc.hpp"
+#include "interpreter.hpp"
+#include <atomic>
+
+namespace squirrel {
+
+static_assert(sizeof(RefCounted) == 2*sizeof(void *), "collector state has to fit in RefCounted's padding");
+
+thread_local CycleCollector *CycleCollector::current = 0;
+
+// Where forget_cycle finds a candidate's collector, by gc_owner; 0 is
+// none, for collectors made once every slot is taken
+static std::atomic<CycleCollector *> collectors[CycleCollector::max_collectors];
+static std::mutex collectors_lock;
+
+enum { BLACK, GRAY, WHITE };
+
+static const RefCounted *const TOMBSTONE = reinterpret_cast<const RefCounted *>(uintptr_t(1));
+
+static size_t slot_hash(const RefCounted *obj)
+{
+    return (uintptr_t(obj) * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+void CycleCollector::RootSet::insert(const RefCounted *obj)
+{
+    if ((used + 1) * 2 > slots.size()) grow();
+    size_t mask = slots.size() - 1;
+    size_t i = slot_hash(obj) & mask;
+    while (slots[i] && slots[i] != TOMBSTONE) i = (i + 1) & mask;
+    if (!slots[i]) used++;
+    slots[i] = obj;
+    count++;
+}
+
+void CycleCollector::RootSet::erase(const RefCounted *obj)
+{
+    if (slots.empty()) return;
+    size_t mask = slots.size() - 1;
+    for (size_t i = slot_hash(obj) & mask; slots[i]; i = (i + 1) & mask) {
+        if (slots[i] == obj) {
+            slots[i] = TOMBSTONE;
+            count--;
+            return;
+        }
+    }
+}
+
+const RefCounted *CycleCollector::RootSet::pop()
+{
+    if (!count) {
+        if (used) {
+            std::fill(slots.begin(), slots.end(), nullptr);
+            used = cursor = 0;
+        }
+        return 0;
+    }
+    size_t mask = slots.size() - 1;
+    for (;; cursor = (cursor + 1) & mask) {
+        const RefCounted *obj = slots[cursor];
+        if (obj && obj != TOMBSTONE) {
+            slots[cursor] = TOMBSTONE;
+            count--;
+            return obj;
+        }
+    }
+}
+
+// Rehashed without tombstones, at least four slots per entry
+void CycleCollector::RootSet::grow()
+{
+    size_t n = 64;
+    while (n < count * 4) n *= 2;
+    std::vector<const RefCounted *> old(n, nullptr);
+    old.swap(slots);
+    count = used = cursor = 0;
+    for (const RefCounted *obj : old) {
+        if (obj && obj != TOMBSTONE) insert(obj);
+    }
+}
+
+CycleCollector::CycleCollector()
+{
+    std::lock_guard<std::mutex> guard(collectors_lock);
+    for (int i=1; i<max_collectors; i++) {
+        if (!collectors[i].load(std::memory_order_relaxed)) {
+            collectors[i].store(this, std::memory_order_relaxed);
+            id = i;
+            break;
+        }
+    }
+}
+
+// Candidates still waiting outlive the collector, and just stop being ones
+CycleCollector::~CycleCollector()
+{
+    if (current == this) current = 0;
+    for (const RefCounted *obj : roots.slots) {
+        if (obj && obj != TOMBSTONE) obj->gc_flags &= ~RefCounted::GC_BUFFERED;
+    }
+    if (!id) return;
+    std::lock_guard<std::mutex> guard(collectors_lock);
+    collectors[id].store(0, std::memory_order_relaxed);
+}
+
+void suspect_cycle(const RefCounted *obj)
+{
+    CycleCollector *c = CycleCollector::current;
+    if (!c || !c->id || RefCounted::threaded) return;
+    obj->gc_flags |= RefCounted::GC_BUFFERED;
+    obj->gc_owner = c->id;
+    c->roots.insert(obj);
+}
+
+void forget_cycle(const RefCounted *obj)
+{
+    obj->gc_flags &= ~RefCounted::GC_BUFFERED;
+    CycleCollector *c = collectors[obj->gc_owner].load(std::memory_order_relaxed);
+    if (!c) return;
+    if (RefCounted::threaded) {
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->roots.erase(obj);
+    } else {
+        c->roots.erase(obj);
+    }
+}
+
+void CycleCollector::keep(const RefCounted *obj, bool on)
+{
+    if (on) {
+        obj->gc_flags |= RefCounted::GC_KEPT;
+    } else {
+        obj->gc_flags &= ~RefCounted::GC_KEPT;
+    }
+}
+
+template <typename F>
+void CycleCollector::each_child(const RefCounted *obj, F f)
+{
+    auto follow = [&f](const RefCounted *child) {
+        if (child && child->gc_kind && !(child->gc_flags & RefCounted::GC_KEPT)) f(child);
+    };
+    auto follow_value = [&follow](const ValuePtr& v) { follow(v.get()); };
+
+    switch (obj->gc_kind) {
+    case GcKind::VALUE: {
+        const Value *v = static_cast<const Value *>(obj);
+        switch (v->type) {
+        case Value::INFIX:
+            follow_value(static_cast<const InfixValue *>(v)->prefix);
+            // fall through
+        case Value::LIST: {
+            const ListValue *l = static_cast<const ListValue *>(v);
+            for (const ValuePtr& item : l->list) follow_value(item);
+            follow(l->parent.get());
+            follow(l->spec.get());
+            break;
+        }
+        case Value::FUNC: {
+            const FunctionValue *fv = static_cast<const FunctionValue *>(v);
+            follow(fv->params.get());
+            follow(fv->body.get());
+            follow(fv->code.get());
+            follow(fv->jit.get());
+            follow(fv->memo.get());
+            break;
+        }
+        case Value::EXCEPTION: {
+            const ExceptionValue *e = static_cast<const ExceptionValue *>(v);
+            follow_value(e->subject);
+            for (const ContextPtr& c : e->trace) follow(c.get());
+            follow(e->context.get());
+            break;
+        }
+        case Value::OBJECT:
+            follow(static_cast<const ObjectValue *>(v)->parent.get());
+            // fall through
+        case Value::CLASS:
+        case Value::CONTEXT:
+            follow(static_cast<const ContextValue *>(v)->context.get());
+            break;
+        }
+        break;
+    }
+    case GcKind::CONTEXT: {
+        const Context *c = static_cast<const Context *>(obj);
+        follow(c->parent.get());
+        c->vars.for_each([&follow_value](const SymbolPtr&, const ValuePtr& v) { follow_value(v); });
+        break;
+    }
+    case GcKind::CODE: {
+        const Code *code = static_cast<const Code *>(obj);
+        for (const ValuePtr& v : code->consts) follow_value(v);
+        for (const GlobalRef& g : code->globals) follow_value(g.value);
+        break;
+    }
+    case GcKind::NODE_SPEC:
+        follow_value(static_cast<const NodeSpec *>(obj)->target);
+        break;
+    case GcKind::JIT_CODE: {
+        const JitCode *jc = static_cast<const JitCode *>(obj);
+        follow(jc->code.get());
+        for (const ValuePtr& v : jc->targets) follow_value(v);
+        break;
+    }
+    case GcKind::MEMO:
+        for (const auto& e : static_cast<const MemoCache *>(obj)->entries) {
+            for (const ValuePtr& v : e.first.args) follow_value(v);
+            follow_value(e.second);
+        }
+        break;
+    }
+}
+
+void CycleCollector::clear(const RefCounted *obj)
+{
+    switch (obj->gc_kind) {
+    case GcKind::VALUE: {
+        Value *v = const_cast<Value *>(static_cast<const Value *>(obj));
+        switch (v->type) {
+        case Value::INFIX:
+            static_cast<InfixValue *>(v)->prefix.reset();
+            // fall through
+        case Value::LIST: {
+            ListValue *l = static_cast<ListValue *>(v);
+            l->list.clear();
+            l->parent.reset();
+            l->spec.reset();
+            break;
+        }
+        case Value::FUNC: {
+            FunctionValue *fv = static_cast<FunctionValue *>(v);
+            fv->params.reset();
+            fv->body.reset();
+            fv->code.reset();
+            fv->jit.reset();
+            fv->memo.reset();
+            break;
+        }
+        case Value::EXCEPTION: {
+            ExceptionValue *e = static_cast<ExceptionValue *>(v);
+            e->subject.reset();
+            e->trace.clear();
+            e->context.reset();
+            break;
+        }
+        case Value::OBJECT:
+            static_cast<ObjectValue *>(v)->parent.reset();
+            // fall through
+        case Value::CLASS:
+        case Value::CONTEXT:
+            static_cast<ContextValue *>(v)->context.reset();
+            break;
+        }
+        break;
+    }
+    case GcKind::CONTEXT: {
+        Context *c = const_cast<Context *>(static_cast<const Context *>(obj));
+        c->parent.reset();
+        c->vars.clear();
+        break;
+    }
+    case GcKind::CODE: {
+        Code *code = const_cast<Code *>(static_cast<const Code *>(obj));
+        code->consts.clear();
+        code->globals.clear();
+        break;
+    }
+    case GcKind::NODE_SPEC:
+        const_cast<NodeSpec *>(static_cast<const NodeSpec *>(obj))->target.reset();
+        break;
+    case GcKind::JIT_CODE: {
+        JitCode *jc = const_cast<JitCode *>(static_cast<const JitCode *>(obj));
+        jc->code.reset();
+        jc->targets.clear();
+        break;
+    }
+    case GcKind::MEMO: {
+        MemoCache *m = const_cast<MemoCache *>(static_cast<const MemoCache *>(obj));
+        m->index.clear();
+        m->entries.clear();
+        break;
+    }
+    }
+}
+
+void CycleCollector::destroy(const RefCounted *obj)
+{
+    switch (obj->gc_kind) {
+    case GcKind::VALUE: delete static_cast<const Value *>(obj); break;
+    case GcKind::CONTEXT: delete const_cast<Context *>(static_cast<const Context *>(obj)); break;
+    case GcKind::CODE: delete static_cast<const Code *>(obj); break;
+    case GcKind::NODE_SPEC: delete static_cast<const NodeSpec *>(obj); break;
+    case GcKind::JIT_CODE: delete static_cast<const JitCode *>(obj); break;
+    case GcKind::MEMO: delete static_cast<const MemoCache *>(obj); break;
+    }
+}
+
+// Takes the references from inside the graph off the counts of everything
+// reachable from root, returning how many objects that was
+size_t CycleCollector::mark_gray(const RefCounted *root)
+{
+    if ((root->gc_flags & RefCounted::GC_KEPT) || (root->gc_flags & RefCounted::GC_COLOR) == GRAY) return 0;
+    root->gc_flags = (root->gc_flags & ~RefCounted::GC_COLOR) | GRAY;
+    stack.assign(1, root);
+    size_t n = 0;
+    while (!stack.empty()) {
+        const RefCounted *obj = stack.back();
+        stack.pop_back();
+        n++;
+        each_child(obj, [this](const RefCounted *child) {
+            child->refs--;
+            if ((child->gc_flags & RefCounted::GC_COLOR) != GRAY) {
+                child->gc_flags = (child->gc_flags & ~RefCounted::GC_COLOR) | GRAY;
+                stack.push_back(child);
+            }
+        });
+    }
+    return n;
+}
+
+// Objects still counted are held from outside, and so is everything they
+// reach; what is left is white
+void CycleCollector::scan(const RefCounted *root)
+{
+    stack.assign(1, root);
+    while (!stack.empty()) {
+        const RefCounted *obj = stack.back();
+        stack.pop_back();
+        if ((obj->gc_flags & RefCounted::GC_COLOR) != GRAY) continue;
+        if (obj->refs > 0) {
+            scan_black(obj);
+        } else {
+            obj->gc_flags = (obj->gc_flags & ~RefCounted::GC_COLOR) | WHITE;
+            each_child(obj, [this](const RefCounted *child) { stack.push_back(child); });
+        }
+    }
+}
+
+// Puts back the counts mark_gray took off for what obj reaches
+void CycleCollector::scan_black(const RefCounted *obj)
+{
+    obj->gc_flags &= ~RefCounted::GC_COLOR;
+    black.assign(1, obj);
+    while (!black.empty()) {
+        const RefCounted *o = black.back();
+        black.pop_back();
+        each_child(o, [this](const RefCounted *child) {
+            child->refs++;
+            if ((child->gc_flags & RefCounted::GC_COLOR) != BLACK) {
+                child->gc_flags &= ~RefCounted::GC_COLOR;
+                black.push_back(child);
+            }
+        });
+    }
+}
+
+void CycleCollector::collect_white(const RefCounted *root)
+{
+    if ((root->gc_flags & RefCounted::GC_COLOR) != WHITE) return;
+    root->gc_flags &= ~RefCounted::GC_COLOR;
+    stack.assign(1, root);
+    while (!stack.empty()) {
+        const RefCounted *obj = stack.back();
+        stack.pop_back();
+        garbage.push_back(obj);
+        each_child(obj, [this](const RefCounted *child) {
+            if ((child->gc_flags & RefCounted::GC_COLOR) == WHITE) {
+                child->gc_flags &= ~RefCounted::GC_COLOR;
+                stack.push_back(child);
+            }
+        });
+    }
+}
+
+// Freeing garbage may leave other cycles held only by themselves, which
+// become candidates as it goes
+size_t CycleCollector::collect()
+{
+    size_t freed = 0;
+    while (size_t n = run(SIZE_MAX)) freed += n;
+    return freed;
+}
+
+size_t CycleCollector::run(size_t limit)
+{
+    if (running || RefCounted::threaded || !roots.size()) return 0;
+    running = true;
+    stats.runs++;
+
+    taken.clear();
+    garbage.clear();
+    size_t traced = 0;
+    while (traced < limit) {
+        const RefCounted *obj = roots.pop();
+        if (!obj) break;
+        obj->gc_flags &= ~RefCounted::GC_BUFFERED;
+        taken.push_back(obj);
+        traced += mark_gray(obj);
+    }
+    for (const RefCounted *obj : taken) scan(obj);
+    for (const RefCounted *obj : taken) collect_white(obj);
+    stats.roots += taken.size();
+    stats.traced += traced;
+    stats.freed += garbage.size();
+
+    // Garbage gets its real counts back, then is held while its references
+    // are dropped, so that none of it goes before all of it is cut loose
+    for (const RefCounted *obj : garbage) {
+        each_child(obj, [](const RefCounted *child) { child->refs++; });
+    }
+    for (const RefCounted *obj : garbage) obj->refs++;
+    for (const RefCounted *obj : garbage) clear(obj);
+    for (const RefCounted *obj : garbage) {
+        if (obj->release()) destroy(obj);
+    }
+
+    running = false;
+    size_t freed = garbage.size();
+    garbage.clear();
+    return freed;
+}
+
+}; // namespace squirrel
@@ -0,0 +1,116 @@
+#ifndef INCLUDED_SQUIRREL_GC_HPP
+#define INCLUDED_SQUIRREL_GC_HPP
+
+#include "types.hpp"
+#include <vector>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+namespace squirrel {
+
+struct GcStats {
+    uint64_t runs = 0;          // steps and full collections
+    uint64_t roots = 0;         // candidates looked at
+    uint64_t traced = 0;        // objects marked from them
+    uint64_t freed = 0;         // objects found in garbage cycles
+
+    void reset() { *this = GcStats(); }
+};
+
+// Frees reference cycles that nothing outside them refers to, which
+// counting alone never does: classes are held by their parent context and
+// hold it in turn, objects may hold each other, and so on.
+//
+// This is trial deletion, after Bacon and Rajan. An object whose count goes
+// down without reaching zero (see RefCounted::dropped) may be left held
+// only by a cycle, so if it is of a kind that can be part of one it is kept
+// as a candidate. A run takes candidates and, over everything reachable
+// from them, subtracts the references that come from inside that graph.
+// Whatever still has a count is held from outside and is live, along with
+// everything it reaches; the rest is garbage. Its references are dropped,
+// which frees it.
+//
+// Each interpreter has a collector, bound to the thread while it evaluates
+// like its slab pools. Objects that become candidates with no collector
+// bound, or while argument workers run, are missed until their count goes
+// down again. step() looks at candidates until it has traced budget
+// objects, and Interpreter::evaluate runs one step when threshold
+// candidates are waiting, so the pause is bounded by the budget plus the
+// graph of the last candidate; collect() looks at them all. Either has to
+// run where nothing refers to objects other than through counted
+// references, which holds between top-level evaluations and in builtins.
+struct CycleCollector {
+    static constexpr int max_collectors = 4096;
+
+    // Candidates waiting before Interpreter::evaluate runs a step
+    size_t threshold = 1000;
+    // Objects a step traces before it stops taking candidates
+    size_t budget = 10000;
+    GcStats stats;
+
+    CycleCollector();
+    CycleCollector(const CycleCollector&) = delete;
+    ~CycleCollector();
+
+    size_t pending() const { return roots.size(); }
+    // Both return the number of objects freed
+    size_t step() { return run(budget); }
+    size_t collect();
+
+    // obj is held by something no collector sees, such as an interpreter
+    // holding its global context, for as long as on is set; it is then
+    // neither traced into nor freed
+    static void keep(const RefCounted *obj, bool on);
+
+    struct Use {
+        CycleCollector *previous;
+
+        Use(CycleCollector *c) : previous(current) { current = c; }
+        ~Use() { current = previous; }
+    };
+
+private:
+    friend void suspect_cycle(const RefCounted *obj);
+    friend void forget_cycle(const RefCounted *obj);
+
+    // Candidates come and go as counts change, so this is a pointer set
+    // with open addressing, which allocates nothing per entry
+    struct RootSet {
+        std::vector<const RefCounted *> slots;
+        size_t count = 0, used = 0, cursor = 0;
+
+        size_t size() const { return count; }
+        void insert(const RefCounted *obj);
+        void erase(const RefCounted *obj);
+        // Any one of them, taken out; null if there are none
+        const RefCounted *pop();
+        void grow();
+    };
+
+    static thread_local CycleCollector *current;
+
+    uint16_t id = 0;
+    bool running = false;
+    RootSet roots;
+    // Kept between runs, so that a run allocates nothing once they have grown
+    std::vector<const RefCounted *> taken, garbage, stack, black;
+    // Taken while argument workers run, when objects may go on any thread
+    std::mutex lock;
+
+    size_t run(size_t limit);
+    // What a collector follows out of obj, by its GcKind. clear() drops the
+    // same references, and destroy() deletes obj as what it is.
+    template <typename F>
+    static void each_child(const RefCounted *obj, F f);
+    static void clear(const RefCounted *obj);
+    static void destroy(const RefCounted *obj);
+    size_t mark_gray(const RefCounted *root);
+    void scan(const RefCounted *root);
+    void scan_black(const RefCounted *obj);
+    void collect_white(const RefCounted *root);
+};
+
+}; // namespace squirrel
+
+#endif
@@ -0,0 +1,131 @@
+#include "interpreter.hpp"
+#include <climits>
+
+namespace squirrel {
+
+// Pratt parser over the items of an InfixValue. A plain symbol bound to an
+// operator in the global context is an operator, anything else an operand.
+// Lower precedence numbers bind tighter. The versions of the operator
+// symbols are recorded, since rebinding one can change the shape.
+struct InfixParser {
+    Interpreter *interp;
+    ListValuePtr items;
+    std::vector<std::pair<SymbolPtr, uint32_t>>& guards;
+    std::string error;
+    int pos = 0;
+    
+    InfixParser(Interpreter *i, ListValuePtr l, std::vector<std::pair<SymbolPtr, uint32_t>>& g) : interp(i), items(l), guards(g) {}
+    
+    OperatorValue *op_at(int i) {
+        if (i >= items->size()) return 0;
+        ValuePtr v = items->get(i);
+        if (!v || v->quote || v->type != Value::SYM) return 0;
+        IdentifierPtr id = static_pointer_cast<SymbolValue>(v)->sym;
+        if (!id->has_first() || id->has_next() || id->first()->has_index()) return 0;
+        SymbolPtr sym = id->first()->sym;
+        auto e = interp->global->vars.entries.find(sym->code);
+        if (e == interp->global->vars.entries.end()) return 0;
+        ValuePtr op = e->second.second;
+        if (!op || op->type != Value::OPER) return 0;
+        bool seen = false;
+        for (const auto& g : guards) {
+            if (g.first == sym) seen = true;
+        }
+        if (!seen) guards.push_back({sym, sym->version});
+        return static_cast<OperatorValue *>(op.get());
+    }
+    
+    static ValuePtr make_call(ValuePtr op, ValuePtr a, ValuePtr b = 0) {
+        ListValuePtr call = ListValue::make();
+        call->append(op);
+        call->append(a);
+        if (b) call->append(b);
+        return call;
+    }
+    
+    ValuePtr parse_primary() {
+        if (pos >= items->size()) {
+            error = "Expected operand in infix expression";
+            return 0;
+        }
+        OperatorValue *op = op_at(pos);
+        if (op) {
+            if (op->order != OpOrder::UNARY) {
+                error = std::string("Expected operand before ") + op->name->as_string() + " in infix expression";
+                return 0;
+            }
+            ValuePtr name = items->get(pos++);
+            ValuePtr arg = parse_expr(op->precedence);
+            if (!arg) return 0;
+            return make_call(name, arg);
+        }
+        ValuePtr v = items->get(pos++);
+        if (v && v->type == Value::INFIX && !v->quote) {
+            InfixParser sub(interp, static_pointer_cast<ListValue>(v), guards);
+            ValuePtr r = sub.parse();
+            if (!r) error = sub.error;
+            return r;
+        }
+        return v;
+    }
+    
+    // Parses operands joined by operators of precedence max_prec or tighter
+    ValuePtr parse_expr(int max_prec) {
+        ValuePtr lhs = parse_primary();
+        if (!lhs) return 0;
+        while (pos < items->size()) {
+            OperatorValue *op = op_at(pos);
+            if (!op || op->order == OpOrder::UNARY) {
+                error = std::string("Expected operator before ") + items->get(pos).as_string() + " in infix expression";
+                return 0;
+            }
+            if (op->precedence > max_prec) break;
+            ValuePtr name = items->get(pos++);
+            ValuePtr rhs = parse_expr(op->order == OpOrder::RASSOC ? op->precedence : op->precedence - 1);
+            if (!rhs) return 0;
+            lhs = make_call(name, lhs, rhs);
+        }
+        return lhs;
+    }
+    
+    ValuePtr parse() {
+        // An empty infix form is left as is, like an empty list
+        if (items->size() == 0) return items;
+        return parse_expr(INT_MAX);
+    }
+};
+
+static bool fresh(const std::vector<std::pair<SymbolPtr, uint32_t>>& guards)
+{
+    for (const auto& g : guards) {
+        if (g.first->version != g.second) return false;
+    }
+    return true;
+}
+
+// The guards of the parse returned are added to used, when it is given
+ValuePtr Interpreter::infix_expr(InfixValuePtr node, ContextPtr c, std::vector<std::pair<SymbolPtr, uint32_t>> *used)
+{
+    // Workers keep their parses to themselves and leave the node as it is
+    ValuePtr *prefix = &node->prefix;
+    std::vector<std::pair<SymbolPtr, uint32_t>> *guards = &node->prefix_guards;
+    if (worker && !(node->prefix && fresh(node->prefix_guards))) {
+        auto& w = worker_infix[node.get()];
+        if (!w.node.refers_to(node.get())) w = {ValueWeakPtr(node), 0, {}};
+        prefix = &w.prefix;
+        guards = &w.guards;
+    }
+    
+    if (!*prefix || !fresh(*guards)) {
+        *prefix = 0;
+        guards->clear();
+        InfixParser p(this, node, *guards);
+        ValuePtr r = p.parse();
+        if (!r) return ExceptionValue::make(p.error + ": " + ValuePtr(node).as_string(), c);
+        *prefix = r;
+    }
+    if (used) used->insert(used->end(), guards->begin(), guards->end());
+    return *prefix;
+}
+
+}; // namespace squirrel
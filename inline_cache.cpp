@@ -0,0 +1,136 @@
+#include "interpreter.hpp"
+
+namespace squirrel {
+
+static bool same_receiver(const ContextWeakPtr& a, const ContextPtr& b)
+{
+    return a.refers_to(b.get());
+}
+
+// Context a read of sym from c finds it in, by the same steps find_owner
+// takes for the first name of a dotted path. Null if find_owner would stop
+// somewhere else, such as at an object whose class binds the name.
+static Context *binding_owner(Context *c, const SymbolPtr& sym)
+{
+    while (c) {
+        if (c->vars.has_key(sym)) return c;
+        if (c->type == Symbol::object_symbol && c->parent && c->parent->type == Symbol::class_symbol &&
+            c->parent->vars.has_key(sym)) return 0;
+        c = c->parent.get();
+    }
+    return 0;
+}
+
+static uint8_t classify(const IdentifierPtr& id)
+{
+    int n = id->syms.size();
+    if (id->parent || n == 0 || n > CacheEntry::max_path) return CacheState::UNCACHEABLE;
+    for (const IndexPtr& ix : id->syms) {
+        if (ix->has_index()) return CacheState::UNCACHEABLE;
+        const SymbolPtr& sym = ix->sym;
+        if (sym == Symbol::parent_symbol || sym == Symbol::global_symbol || sym == Symbol::class_symbol ||
+            sym == Symbol::object_symbol || sym == Symbol::local_symbol) return CacheState::UNCACHEABLE;
+    }
+    return CacheState::ACTIVE;
+}
+
+ValuePtr Interpreter::lookup_function(ListValue *node, SymbolValuePtr name, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context)
+{
+    if (!node || !inline_caches) return caller->get(name, caller, exec_context, func_context);
+    CallCachePtr *slot = &node->cache;
+    if (worker) {
+        auto& w = worker_caches[node];
+        if (!w.first.refers_to(node)) w = {ValueWeakPtr(Ref<Value>(node)), 0};
+        slot = &w.second;
+    }
+    if (!*slot) *slot = CallCache::make();
+    CallCache& cache(**slot);
+    
+    const IdentifierPtr& id(name->sym);
+    // A node's head can be changed in place, so the path it was classified
+    // for has to be the one it has now
+    if (cache.state == CacheState::UNINIT || cache.path_size != id->syms.size()) {
+        cache.entries.clear();
+        cache.state = classify(id);
+        cache.path_size = id->syms.size();
+    }
+    if (cache.state != CacheState::ACTIVE) {
+        cache_stats.misses++;
+        return caller->get(name, caller, exec_context, func_context);
+    }
+    
+    const std::vector<IndexPtr>& path(id->syms);
+    int n = cache.path_size;
+    int first = 0;
+    ContextPtr receiver;
+    if (path[0]->sym->local_binding) {
+        // Only the rest of a dotted path can be cached for a local first name
+        Context *owner = n > 1 ? binding_owner(caller.get(), path[0]->sym) : 0;
+        ValuePtr v = owner ? owner->vars.get(path[0]->sym) : 0;
+        if (!v || !v->has_context()) {
+            cache_stats.misses++;
+            return caller->get(name, caller, exec_context, func_context);
+        }
+        receiver = v->get_context();
+        first = 1;
+    }
+    
+    CacheEntry *entry = 0;
+    for (CacheEntry& e : cache.entries) {
+        if (same_receiver(e.receiver, receiver)) {
+            entry = &e;
+            break;
+        }
+    }
+    if (entry) {
+        bool fresh = true;
+        for (int i=first; i<n; i++) {
+            if (entry->versions[i] != path[i]->sym->version) {
+                fresh = false;
+                break;
+            }
+        }
+        if (fresh) {
+            ValuePtr func = entry->func.lock();
+            exec_context = entry->exec_context.lock();
+            func_context = entry->func_context.lock();
+            if (func && exec_context && func_context) {
+                cache_stats.hits++;
+                return func;
+            }
+        }
+    }
+    
+    cache_stats.misses++;
+    ValuePtr func = caller->get(name, caller, exec_context, func_context);
+    if (func->type != Value::FUNC && func->type != Value::OPER) return func;
+    if (!exec_context || !func_context) return func;
+    
+    if (!entry) {
+        // Reuse the slot of a receiver that no longer exists before growing
+        for (CacheEntry& e : cache.entries) {
+            if (e.receiver.expired() && !same_receiver(e.receiver, 0)) {
+                entry = &e;
+                break;
+            }
+        }
+    }
+    if (!entry) {
+        if (cache.entries.size() >= CallCache::max_entries) {
+            cache.state = CacheState::MEGAMORPHIC;
+            cache.entries.clear();
+            cache_stats.megamorphic++;
+            return func;
+        }
+        cache.entries.emplace_back();
+        entry = &cache.entries.back();
+    }
+    entry->receiver = receiver;
+    for (int i=0; i<n; i++) entry->versions[i] = path[i]->sym->version;
+    entry->func = func.ptr;
+    entry->exec_context = exec_context;
+    entry->func_context = func_context;
+    return func;
+}
+
+}; // namespace squirrel
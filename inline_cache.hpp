@@ -0,0 +1,55 @@
+#ifndef INCLUDED_SQUIRREL_INLINE_CACHE_HPP
+#define INCLUDED_SQUIRREL_INLINE_CACHE_HPP
+
+#include "value.hpp"
+
+namespace squirrel {
+
+namespace CacheState {
+    enum {
+        UNINIT,         // no lookup done yet
+        ACTIVE,         // entries are kept, one per receiver
+        MEGAMORPHIC,    // too many receivers, always do the full lookup
+        UNCACHEABLE     // head uses indexes or special names, or is too long
+    };
+};
+
+// One resolved head. Every symbol of the path is stamped with its version
+// at lookup time; any set/unset of one of them makes the entry stale.
+// Everything is held weakly so a cache inside a function body never keeps
+// that function or its class alive.
+struct CacheEntry {
+    static constexpr int max_path = 4;
+    
+    ContextWeakPtr receiver;
+    uint32_t versions[max_path];
+    ValueWeakPtr func;
+    ContextWeakPtr exec_context, func_context;
+};
+
+// Per call node cache of what the head resolves to. A head whose first name
+// was only ever bound globally resolves the same from every caller, so it
+// has one entry. If the first name is a local binding, the rest of the path
+// is resolved relative to the context that name holds, and the entries are
+// keyed by that receiver context.
+struct CallCache : public RefCounted {
+    static constexpr int max_entries = 4;
+    
+    uint8_t state = CacheState::UNINIT;
+    uint8_t path_size = 0;
+    std::vector<CacheEntry> entries;
+    
+    static CallCachePtr make() { return make_ref<CallCache>(); }
+};
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t megamorphic = 0;
+    
+    void reset() { *this = CacheStats(); }
+};
+
+}; // namespace squirrel
+
+#endif
@@ -1,10 +1,12 @@
 #include "interpreter.hpp"
+#include <pthread.h>
 
 namespace squirrel {
     
 ValuePtr Interpreter::evaluate(ValuePtr v, ContextPtr c)
 {
     if (!c) c = global;
+    if (!budget.step()) return stopped(c);
     
     std::cout << "Executing: " << v << std::endl;
     if (!v->quote) {
@@ -13,36 +15,154 @@ ValuePtr Interpreter::evaluate(ValuePtr v, ContextPtr c)
             ListValuePtr l = CAST_LIST(v, 0);
             ValuePtr name = CHECK_EXCEPTION_WRAP(l->get(0), c);
             std::cout << "Name: " << name << std::endl;
-            if (name->type == Value::LIST) return evaluate_body(l, c);
+            if (name->type == Value::LIST || name->type == Value::INFIX) return evaluate_body(l, c);
             // XXX throw exception for invalid function call. If it's a list, just return that.
             if (name->type != Value::SYM) return v; 
-            ListValuePtr args = l->sub(1);
-            std::cout << "args: " << ValuePtr(args) << std::endl;
-            return CHECK_EXCEPTION_WRAP(call_function(CAST_SYMBOL(name, 0), args, c), c);
+            if (tier == ExecTier::SPECIALIZE) return evaluate_call(l, CAST_SYMBOL(name, 0), c);
+            std::cout << "args: {";
+            l->print(std::cout, 1) << '}' << std::endl;
+            return CHECK_EXCEPTION_WRAP(call_function(CAST_SYMBOL(name, 0), l.get(), 1, c), c);
         }
         if (v->type == Value::SYM) {
             SymbolValuePtr s = CAST_SYMBOL(v, 0);
             return c->get(s, c);
         }
+        if (v->type == Value::INFIX) {
+            ValuePtr e = CHECK_EXCEPTION(infix_expr(CAST_INFIX(v, 0), c));
+            if (e == v) return v;
+            return evaluate(e, c);
+        }
     }
     return v;
 }
 
-ValuePtr Interpreter::call_function(SymbolValuePtr name, ListValuePtr args, ContextPtr caller)
+// Calls the function named by the head of a call node, whose arguments are
+// its items from first on
+ValuePtr Interpreter::call_function(SymbolValuePtr name, ListValue *items, int first, ContextPtr caller)
 {
-    if (caller->stack_depth >= 1000) {
-        return ExceptionValue::make(std::string("Call stack limit exceeded: ") + name->as_string(), caller);
-    }
-    
     ContextPtr exec_context, func_context;    
-    // Look up name to get function/operator
-    ValuePtr func = CHECK_EXCEPTION(caller->get(name, caller, exec_context, func_context));
-    if (func->type != Value::FUNC && func->type != Value::OPER) 
-        return ExceptionValue::make(std::string("Not a valid function or operator: ") + func->as_string(), caller);
+    ValuePtr func = CHECK_EXCEPTION(resolve_function(name, caller, exec_context, func_context, items));
+    
+    // Fixed-arity operators get their evaluated args without a list
+    int n = items->size() - first;
+    if (parallel_threads && n >= 2 && !func->quote && func->type != Value::CLASS) {
+        std::vector<ValuePtr> values(n);
+        if (evaluate_parallel(items, first, caller, values.data())) return call_values(func, values.data(), n, caller, exec_context, func_context);
+    }
+    OperatorValue *ov = func->quote ? 0 : OperatorValue::with_arity(func, n);
+    if (ov) return call_fixed(ov, items, first, caller);
+    if (func->type == Value::FUNC && !func->quote) {
+        return call_direct(static_pointer_cast<FunctionValue>(func), items, first, caller, exec_context, func_context);
+    }
     
     // If the function/operator itself if not quoted, then evaluate all args
+    ListValuePtr args = items->sub(first);
     if (!func->quote) args = evaluate_list(args, caller);
     
+    return apply_function(func, args, caller, exec_context, func_context);
+}
+
+// Calls func, which evaluates its arguments, with their n values
+ValuePtr Interpreter::call_values(ValuePtr func, const ValuePtr *args, int n, const ContextPtr& c, ContextPtr exec_context, ContextPtr func_context)
+{
+    OperatorValue *ov = OperatorValue::with_arity(func, n);
+    if (ov) return ov->call(args, n, c);
+    if (func->type == Value::FUNC) {
+        FunctionValuePtr fv = static_pointer_cast<FunctionValue>(func);
+        if (fv->memo) return call_memo(fv, args, n, c, exec_context, func_context);
+        ContextPtr fc;
+        CHECK_EXCEPTION(enter_function(fv, args, n, c, exec_context, func_context, fc));
+        return run_body(fv, fc);
+    }
+    ListValuePtr list = ListValue::make();
+    list->list.assign(args, args + n);
+    return apply_function(func, list, c, exec_context, func_context);
+}
+
+// Calls ov with the values of items from first on, which ov has an entry
+// point for
+ValuePtr Interpreter::call_fixed(OperatorValue *ov, ListValue *items, int first, const ContextPtr& c)
+{
+    int n = items->size() - first;
+    ValuePtr a[3];
+    for (int i=0; i<n; i++) a[i] = evaluate(items->get(first+i), c);
+    return ov->call(a, n, c);
+}
+
+// Calls fv with the values of items from first on, evaluated straight into
+// an array for enter_function to bind
+ValuePtr Interpreter::call_direct(FunctionValuePtr fv, ListValue *items, int first, const ContextPtr& c, ContextPtr exec_context, ContextPtr func_context)
+{
+    int n = items->size() - first;
+    ValuePtr small[8];
+    std::vector<ValuePtr> large;
+    ValuePtr *a = small;
+    if (n > 8) {
+        large.resize(n);
+        a = large.data();
+    }
+    for (int i=0; i<n; i++) a[i] = evaluate(items->get(first+i), c);
+    if (fv->memo) return call_memo(fv, a, n, c, exec_context, func_context);
+    ContextPtr fc;
+    CHECK_EXCEPTION(enter_function(fv, a, n, c, exec_context, func_context, fc));
+    return run_body(fv, fc);
+}
+
+ValuePtr Interpreter::resolve_function(SymbolValuePtr name, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, ListValue *node)
+{
+    if (!budget.step()) return stopped(caller);
+    if (depth_exceeded(caller)) {
+        return ExceptionValue::make("Call stack limit exceeded: ", name, caller);
+    }
+    
+    // Look up name to get function/operator
+    ValuePtr func = CHECK_EXCEPTION(lookup_function(node, name, caller, exec_context, func_context));
+    if (func->type != Value::FUNC && func->type != Value::OPER) 
+        return ExceptionValue::make("Not a valid function or operator: ", func, caller);
+    return func;
+}
+
+// Budget ran out; nothing catches this, and the budget stays spent
+ValuePtr Interpreter::stopped(const ContextPtr& c)
+{
+    static const char *why[] = {"Evaluation stopped", "Fuel exhausted", "Deadline passed", "Evaluation cancelled"};
+    ExceptionValuePtr e = ExceptionValue::make(why[budget.reason], c);
+    e->stopped = true;
+    return e;
+}
+
+// Cycles through the global context, such as classes, go with it. Workers
+// share the main interpreter's, and leave it alone.
+Interpreter::~Interpreter()
+{
+    arg_pool.reset();
+    if (worker) return;
+    SlabPools::Use use(&pools);
+    CycleCollector::Use gc(&collector);
+    CycleCollector::keep(global.get(), false);
+    last_result.reset();
+    global.reset();
+    collector.collect();
+}
+
+// Evaluates the arguments of an operator with lazy ones that aren't
+// marked lazy. Arguments that are all lazy are passed on as they are.
+ListValuePtr Interpreter::evaluate_eager(uint32_t lazy, ListValuePtr args, ContextPtr c)
+{
+    int n = args->size();
+    uint32_t all = n < 31 ? (1u << n) - 1 : ~0u;
+    if ((lazy & all) == all) return args;
+    
+    ListValuePtr out = ListValue::make();
+    for (int i=0; i<n; i++) {
+        ValuePtr v = args->get(i);
+        out->append((lazy & (1u << (i < 31 ? i : 31))) ? v : evaluate(v, c));
+    }
+    return out;
+}
+
+ValuePtr Interpreter::apply_function(ValuePtr func, ListValuePtr args, ContextPtr caller, ContextPtr exec_context, ContextPtr func_context)
+{
     if (func->type == Value::CLASS) {
         ObjectValuePtr obj = ObjectValue::make();
         obj->parent = CAST_CLASS(func, 0);
@@ -56,37 +176,22 @@ ValuePtr Interpreter::call_function(SymbolValuePtr name, ListValuePtr args, Cont
         evaluate_body(args, obj->context);
         return obj;
     } else if (func->type == Value::FUNC) {        
-        // For function, create local variable context
-        ContextPtr c;
-        if (func_context->type == Symbol::class_symbol) {
-            c = exec_context->make_function_context(func->get_name());
-            c->stack_depth = caller->stack_depth+1;
-        } else {
-            c = caller->make_function_context(func->get_name());
-        }
-        // Assign args
         FunctionValuePtr fv = CAST_FUNC(func, 0);
-        ListValuePtr params = fv->params;
-        int n = std::min(args->size(), params->size());
-        for (int i=0; i<n; i++) {
-            ValuePtr param = params->get(i);
-            if (param->type != Value::SYM) {
-                return ExceptionValue::make(std::string("Not a valid function parameter: ") + params->as_string(), caller);
-            }
-            if (params->quote) {
-                // If last param name is quoted, put rest of args into list
-                c->set(param, evaluate_list(args->sub(i), caller), caller);
-                break;
-            } else {
-                c->set(param, evaluate(args->get(i), caller), caller);
-            }
+        if (fv->quote || args->quote) {
+            // Arguments as written: params still get their values
+            ListValuePtr values = ListValue::make();
+            for (int i=0; i<args->size(); i++) values->append(evaluate(args->get(i), caller));
+            args = values;
         }
-        // XXX deal with args/params mismatch
+        if (fv->memo) return call_memo(fv, args->items(), args->size(), caller, exec_context, func_context);
+        ContextPtr c;
+        CHECK_EXCEPTION(enter_function(fv, args->items(), args->size(), caller, exec_context, func_context, c));
         // Execute body of function 
-        return evaluate_body(fv->body, c);
+        return run_body(fv, c);
     } else {
         std::cout << "Operator\n";
         OperatorValuePtr ov = CAST_OPER(func, 0);
+        if (ov->lazy) args = evaluate_eager(ov->lazy, args, caller);
         // Call operator
         ValuePtr vp = ov->oper(args, caller);
         // std::cout << "operator returns: " << vp << std::endl;
@@ -94,6 +199,132 @@ ValuePtr Interpreter::call_function(SymbolValuePtr name, ListValuePtr args, Cont
     }
 }
 
+// Fills in fv->layout and fv->slot_params, on the first call of fv
+void Interpreter::layout_params(FunctionValue *fv)
+{
+    fv->layout = SlotLayout::make();
+    fv->slot_params = true;
+    for (int i=0; i<fv->params->size(); i++) {
+        SymbolPtr sym = Compiler::plain_symbol(fv->params->get(i), true);
+        if (!sym || fv->layout->add(sym) != i) {
+            fv->slot_params = false;
+            return;
+        }
+    }
+}
+
+// Creates the local variable context for a call of fv and binds its params
+// to the n argument values in args. Params that are plain names go straight
+// into their frame slots.
+// For a tail call the new frame takes the place of caller, which must be a
+// function frame: it hangs off the caller's parent at the same depth, and
+// starts out with the caller's bindings so that lookups through it see the
+// same values as they would through the caller.
+ValuePtr Interpreter::enter_function(FunctionValuePtr fv, const ValuePtr *args, int n, ContextPtr caller, ContextPtr exec_context, ContextPtr func_context, ContextPtr& c, bool tail)
+{
+    if (func_context->type == Symbol::class_symbol) {
+        c = exec_context->make_function_context(fv->get_name());
+        c->stack_depth = tail ? caller->stack_depth : caller->stack_depth+1;
+    } else if (tail) {
+        c = caller->parent->make_function_context(fv->get_name());
+        c->stack_depth = caller->stack_depth;
+    } else {
+        c = caller->make_function_context(fv->get_name());
+    }
+    if (!fv->layout) layout_params(fv.get());
+    CodePtr code = function_code(fv);
+    c->vars.use_layout(code ? code->layout : fv->layout);
+    if (tail && func_context->type != Symbol::class_symbol) c->vars.inherit(caller->vars);
+    
+    // Assign args
+    ListValuePtr params = fv->params;
+    int count = std::min(n, params->size());
+    for (int i=0; i<count; i++) {
+        ValuePtr param = params->get(i);
+        if (param->type != Value::SYM) {
+            return ExceptionValue::make("Not a valid function parameter: ", params, caller);
+        }
+        ValuePtr v = args[i];
+        if (params->quote) {
+            // If last param name is quoted, put rest of args into list
+            ListValuePtr rest = ListValue::make();
+            rest->list.assign(args + i, args + n);
+            v = rest;
+        }
+        if (fv->slot_params) {
+            c->vars.set_slot(i, std::move(v));
+        } else {
+            c->set(param, v, caller);
+        }
+        if (params->quote) break;
+    }
+    // XXX deal with args/params mismatch
+    return 0;
+}
+
+CodePtr Interpreter::function_code(FunctionValuePtr fv)
+{
+    if (tier < ExecTier::BYTECODE || fv->compile_failed) return 0;
+    if (worker) {
+        auto& w = worker_code[fv.get()];
+        if (!w.first.refers_to(fv.get()) || (w.second && w.second->stale())) {
+            w = {ValueWeakPtr(fv), Compiler::compile_function(fv, this)};
+        }
+        return w.second;
+    }
+    // Compile on first call; on failure, keep tree-walking this function
+    if (fv->code && fv->code->stale()) {
+        // An infix form in the body would now parse differently
+        fv->code = 0;
+        fv->jit = 0;
+        fv->jit_failed = false;
+        fv->calls = 0;
+    }
+    if (!fv->code) {
+        fv->code = Compiler::compile_function(fv, this);
+        if (!fv->code) fv->compile_failed = true;
+    }
+    return fv->code;
+}
+
+JitCodePtr Interpreter::function_jit(FunctionValuePtr fv)
+{
+    if (tier != ExecTier::JIT || fv->jit_failed) return 0;
+    if (!fv->jit && ++fv->calls >= jit_threshold) {
+        fv->jit = JitCode::compile(fv->code, global);
+        if (!fv->jit) fv->jit_failed = true;
+    }
+    return fv->jit;
+}
+
+void Interpreter::mark_stack()
+{
+#ifdef __linux__
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr)) return;
+    void *low;
+    size_t size;
+    if (!pthread_attr_getstack(&attr, &low, &size) && size > 2*native_stack_reserve) {
+        stack_floor = static_cast<const char *>(low) + native_stack_reserve;
+    }
+    pthread_attr_destroy(&attr);
+#endif
+}
+
+ValuePtr Interpreter::run_body(FunctionValuePtr fv, ContextPtr c)
+{
+    ValuePtr r;
+    native_depth++;
+    if (CodePtr code = function_code(fv)) {
+        JitCodePtr jit = function_jit(fv);
+        r = jit ? jit->run(this, c) : execute(code, c);
+    } else {
+        r = evaluate_body(fv->body, c);
+    }
+    native_depth--;
+    return r;
+}
+
 ListValuePtr Interpreter::evaluate_list(ListValuePtr in, ContextPtr c)
 {
     if (!c) c = global;
@@ -122,11 +353,33 @@ ValuePtr Interpreter::evaluate_body(ListValuePtr in, ContextPtr c)
     return out;
 }
 
-void Interpreter::add_operator(const std::string_view& name, built_in_f op, int precedence, int order, bool no_eval)
+OperatorValuePtr Interpreter::add_operator(const std::string_view& name, built_in_f op, int precedence, int order, bool no_eval)
 {
     SymbolPtr sym = Symbol::make(name);
     OperatorValuePtr ov = squirrel::OperatorValue::make(sym, op, precedence, order, no_eval);
     global->set(sym, ov);
+    return ov;
+}
+
+OperatorValuePtr Interpreter::add_operator(const std::string_view& name, built_in_f op, built_in1_f op1, int precedence, int order)
+{
+    OperatorValuePtr ov = add_operator(name, op, precedence, order);
+    ov->oper1 = op1;
+    return ov;
+}
+
+OperatorValuePtr Interpreter::add_operator(const std::string_view& name, built_in_f op, built_in2_f op2, int precedence, int order)
+{
+    OperatorValuePtr ov = add_operator(name, op, precedence, order);
+    ov->oper2 = op2;
+    return ov;
+}
+
+OperatorValuePtr Interpreter::add_operator(const std::string_view& name, built_in_f op, built_in3_f op3, int precedence, int order)
+{
+    OperatorValuePtr ov = add_operator(name, op, precedence, order);
+    ov->oper3 = op3;
+    return ov;
 }
 
 }; // namespace squirrel
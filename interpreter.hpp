@@ -4,6 +4,16 @@
 #include "value.hpp"
 #include "context.hpp"
 #include "parser.hpp"
+#include "compiler.hpp"
+#include "specialize.hpp"
+#include "inline_cache.hpp"
+#include "memo.hpp"
+#include "frame_arena.hpp"
+#include "slab.hpp"
+#include "gc.hpp"
+#include "parallel.hpp"
+#include "budget.hpp"
+#include "jit.hpp"
 
 namespace squirrel {
 
@@ -15,26 +25,232 @@ namespace OpOrder {
     };
 };
 
+namespace OpKernel {
+    enum {
+        NONE,
+        ADD,
+        SUB,
+        MUL,
+        LT,
+        GT,
+        LE,
+        GE,
+        EQ,
+        NE
+    };
+};
+
+namespace ControlOp {
+    enum {
+        NONE,
+        IF,
+        WHILE,
+        FOR,
+        EACH,
+        AND,
+        OR
+    };
+};
+
+namespace ExecTier {
+    enum {
+        TREE,
+        SPECIALIZE,
+        BYTECODE,
+        JIT
+    };
+};
+
 constexpr bool NoEval = true;
-    
+
+// Binds a for loop's variable to i. While the binding still holds last, the
+// value from the previous iteration, it is updated in place. That is still a
+// set as far as the symbol's version goes, which caches of global bindings
+// (see Interpreter::load_global) hold copies against.
+inline void bind_counter(Dictionary& vars, const SymbolPtr& var, ValuePtr& last, int64_t i)
+{
+    ValuePtr *bound = last ? vars.binding(var) : 0;
+    if (bound && *bound == last) {
+        var->bump(vars.global);
+        bound->imm.ival = i;
+        last.imm.ival = i;
+    } else {
+        last = IntValue::make(i);
+        vars.set(var, last);
+    }
+}
+
 struct Interpreter {
+    // Free lists for what this interpreter makes, bound to the thread while
+    // it evaluates, see slab.hpp
+    SlabPools pools;
+    // Frees reference cycles, see gc.hpp. Bound along with pools; steps
+    // run between top-level evaluations.
+    CycleCollector collector;
+    // What the last evaluate() of source text returned. The caller drops
+    // its own copy where no collector is bound, so if this one goes last,
+    // as the next evaluation starts, cycles it held become candidates.
+    ValuePtr last_result;
+    // Declared ahead of everything that holds frames, so that it goes after
+    // them: frames still held by globals are given back to it as they go
+    FrameArena frames;
     ContextPtr global = Context::make_global(this);
+    int tier = ExecTier::BYTECODE;
+    // Calls through call_function before a function is compiled to native code
+    int jit_threshold = 50;
+    // Resource limits. Frames are counted by Context::stack_depth, which tail
+    // calls don't grow. Bytecode calls run on the VM's own frame stack; only
+    // bodies entered natively (tree walking, operators, JIT code), and VM
+    // frames in the JIT tier (see execute), count against max_native_depth.
+    int max_depth = 100000;
+    int max_native_depth = 1000;
+    int native_depth = 0;
+    // Bodies whose calls nest more native frames than usual, or bigger
+    // ones, can run out of stack first, so calls also fail once the
+    // thread's stack is down to the last native_stack_reserve bytes.
+    // mark_stack() finds that point for the thread, once.
+    size_t native_stack_reserve = 256 << 10;
+    static inline thread_local const char *stack_floor = 0;
+    void mark_stack();
+    // Fuel, deadline and cancel flag for each evaluate() of source text,
+    // see budget.hpp. stopped() is the exception for running out.
+    Budget budget;
+    ValuePtr stopped(const ContextPtr& c);
+    // Set while evaluating the body of a try that throws any exception
+    // away, so frames aren't recorded on exceptions (see builtin_try)
+    bool untraced = false;
+    // Where print writes, which may be apart from the tracing on std::cout
+    std::ostream *output = &std::cout;
+    // Threads for evaluating the arguments of a call in parallel when they
+    // are pure and at least two of them call user functions; 0 is off.
+    // See parallel.cpp.
+    int parallel_threads = 0;
+    std::unique_ptr<ArgPool> arg_pool;
+    // One of arg_pool's interpreters: writes nothing it shares, so it
+    // keeps the bytecode, call caches and infix parses it makes here
+    // rather than on the functions and nodes themselves
+    bool worker = false;
+    std::unordered_map<FunctionValue *, std::pair<ValueWeakPtr, CodePtr>> worker_code;
+    // Keyed by address, which a node freed during a batch can pass on to
+    // another, so each also refers weakly to the node it was made for
+    std::unordered_map<ListValue *, std::pair<ValueWeakPtr, CallCachePtr>> worker_caches;
+    struct WorkerInfix {
+        ValueWeakPtr node;
+        ValuePtr prefix;
+        std::vector<std::pair<SymbolPtr, uint32_t>> guards;
+    };
+    std::unordered_map<InfixValue *, WorkerInfix> worker_infix;
         
     ValuePtr evaluate(ValuePtr v, ContextPtr c = 0);
     ListValuePtr evaluate_list(ListValuePtr in, ContextPtr c = 0);
+    // A lazy argument is its own thunk: the expression, forced in the
+    // context the operator was called from
+    ValuePtr force(const ValuePtr& thunk, const ContextPtr& c) { return evaluate(thunk, c); }
     ValuePtr evaluate_body(ListValuePtr in, ContextPtr c = 0);
-    ValuePtr call_function(SymbolValuePtr name, ListValuePtr args, ContextPtr caller);
+    ValuePtr call_function(SymbolValuePtr name, ListValue *items, int first, ContextPtr caller);
+    ValuePtr resolve_function(SymbolValuePtr name, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context, ListValue *node = 0);
+    ValuePtr apply_function(ValuePtr func, ListValuePtr args, ContextPtr caller, ContextPtr exec_context, ContextPtr func_context);
+    ListValuePtr evaluate_eager(uint32_t lazy, ListValuePtr args, ContextPtr c);
+    ValuePtr call_values(ValuePtr func, const ValuePtr *args, int n, const ContextPtr& c, ContextPtr exec_context, ContextPtr func_context);
+    ValuePtr call_fixed(OperatorValue *ov, ListValue *items, int first, const ContextPtr& c);
+    ValuePtr call_direct(FunctionValuePtr fv, ListValue *items, int first, const ContextPtr& c, ContextPtr exec_context, ContextPtr func_context);
+    ValuePtr enter_function(FunctionValuePtr fv, const ValuePtr *args, int n, ContextPtr caller, ContextPtr exec_context, ContextPtr func_context, ContextPtr& c, bool tail = false);
+    ValuePtr run_body(FunctionValuePtr fv, ContextPtr c);
+    // Call of a function with a result cache, see memo.cpp
+    ValuePtr call_memo(FunctionValuePtr fv, const ValuePtr *args, int n, ContextPtr caller, ContextPtr exec_context, ContextPtr func_context);
+    static void layout_params(FunctionValue *fv);
+    CodePtr function_code(FunctionValuePtr fv);
+    JitCodePtr function_jit(FunctionValuePtr fv);
+    bool depth_exceeded(const ContextPtr& c) const {
+        char here;
+        return c->stack_depth >= max_depth || native_depth >= max_native_depth || std::less<const char *>()(&here, stack_floor);
+    }
+    
+    // Purity and parallel arguments, see parallel.cpp
+    int arg_kind(const ValuePtr& v, std::vector<std::pair<SymbolPtr, uint32_t>> *guards, std::vector<FunctionValue *>& visiting);
+    bool function_is_pure(FunctionValue *fv, std::vector<std::pair<SymbolPtr, uint32_t>> *guards, std::vector<FunctionValue *>& visiting);
+    bool pure_function(FunctionValue *fv);
+    bool parallel_candidate(ListValue *node);
+    bool evaluate_parallel(ListValue *items, int first, const ContextPtr& c, ValuePtr *out);
+    
+    // Operator precedence for InfixValue, see infix.cpp
+    ValuePtr infix_expr(InfixValuePtr node, ContextPtr c, std::vector<std::pair<SymbolPtr, uint32_t>> *used = 0);
+    
+    // Per call node lookup caches, see inline_cache.cpp
+    bool inline_caches = true;
+    CacheStats cache_stats;
+    ValuePtr lookup_function(ListValue *node, SymbolValuePtr name, ContextPtr caller, ContextPtr& exec_context, ContextPtr& func_context);
     
-    void add_operator(const std::string_view& name, built_in_f op, int precedence = 0, int order = 0, bool no_eval = false);
+    // Self-specializing call nodes, see specialize.cpp
+    SpecStats spec_stats;
+    ValuePtr evaluate_call(ListValuePtr node, SymbolValuePtr name, ContextPtr c);
+    ValuePtr evaluate_first_call(ListValuePtr node, SymbolValuePtr name, ContextPtr c);
+    
+    // Bytecode VM, see vm.cpp
+    struct PendingCall {
+        ValuePtr func;
+        ContextPtr exec_context, func_context;
+    };
+    struct VmFrame {
+        CodePtr code;
+        ContextPtr c;
+        int pc, base, call_base;
+    };
+    std::vector<ValuePtr> vm_stack;
+    std::vector<PendingCall> vm_calls;
+    std::vector<VmFrame> vm_frames;
+    ValuePtr execute(CodePtr code, ContextPtr c);
+    ValuePtr load_global(GlobalRef& g, const ValuePtr& name, const ContextPtr& c);
+    
+    OperatorValuePtr add_operator(const std::string_view& name, built_in_f op, int precedence = 0, int order = 0, bool no_eval = false);
+    // Also register a fixed-arity entry point, used when the argument count matches
+    OperatorValuePtr add_operator(const std::string_view& name, built_in_f op, built_in1_f op1, int precedence = 0, int order = 0);
+    OperatorValuePtr add_operator(const std::string_view& name, built_in_f op, built_in2_f op2, int precedence = 0, int order = 0);
+    OperatorValuePtr add_operator(const std::string_view& name, built_in_f op, built_in3_f op3, int precedence = 0, int order = 0);
     
     void load_operators();    
-    Interpreter() { load_operators(); }
+    Interpreter() {
+        SlabPools::Use use(&pools);
+        CycleCollector::Use gc(&collector);
+        CycleCollector::keep(global.get(), true);
+        load_operators();
+    }
+    // Argument worker for main (see parallel.hpp). It uses main's global
+    // context, and so main's operators: registering them again would bump
+    // their symbols' versions, which every cache and guard in main checks.
+    explicit Interpreter(Interpreter *main) : global(main->global) {
+        tier = ExecTier::BYTECODE;
+        worker = true;
+        frames.heap_only = true;
+        max_depth = main->max_depth;
+        max_native_depth = main->max_native_depth;
+        native_stack_reserve = main->native_stack_reserve;
+    }
+    ~Interpreter();
     
     ValuePtr parse(const std::string_view& s) {
         return Parser::parse(s);
     }
     ValuePtr evaluate(const std::string_view& s) {
-        return evaluate(parse(s));
+        SlabPools::Use use(&pools);
+        CycleCollector::Use gc(&collector);
+        bool outermost = gc.previous != &collector;
+        if (outermost) last_result.reset();
+        if (!stack_floor) mark_stack();
+        budget.start();
+        ValuePtr r;
+        {
+            ValuePtr form = parse(s);
+            CodePtr code = tier >= ExecTier::BYTECODE ? Compiler::compile_form(form, this) : 0;
+            r = code ? execute(code, global) : evaluate(form);
+        }
+        // Operators may drop an exception argument, but not running out
+        if (budget.reason && !(r && r->type == Value::EXCEPTION && static_cast<ExceptionValue *>(r.get())->stopped)) {
+            r = stopped(global);
+        }
+        if (outermost) last_result = r;
+        if (outermost && collector.pending() >= collector.threshold) collector.step();
+        return r;
     }
 };
     
@@ -0,0 +1,654 @@
+#include "jit.hpp"
+#include "interpreter.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#define SQUIRREL_JIT 1
+#endif
+
+namespace squirrel {
+
+typedef Interpreter::PendingCall PendingCall;
+
+// Helpers called from native code. Slot and constant operands are
+// indices into the frame, so the generated code only passes immediates.
+
+static void jit_const(JitFrame *f, int k, int dst)
+{
+    f->slots[dst] = f->consts[k];
+}
+
+static void jit_load(JitFrame *f, int k, int dst)
+{
+    ContextPtr c = f->c->shared_from_this();
+    f->slots[dst] = c->get(f->consts[k], c);
+}
+
+static void jit_load_local(JitFrame *f, int slot, int k, int dst)
+{
+    if (f->locals && f->locals[slot]) {
+        f->slots[dst] = f->locals[slot];
+    } else {
+        ContextPtr c = f->c->shared_from_this();
+        f->slots[dst] = c->get(f->consts[k], c);
+    }
+}
+
+static void jit_load_global(JitFrame *f, int g, int k, int dst)
+{
+    f->slots[dst] = f->interp->load_global(f->globals[g], f->consts[k], f->c->shared_from_this());
+}
+
+static void jit_eval(JitFrame *f, int k, int dst)
+{
+    f->slots[dst] = f->interp->evaluate(f->consts[k], f->c->shared_from_this());
+}
+
+static void jit_pop(JitFrame *f, int dst)
+{
+    f->slots[dst].reset();
+}
+
+static void jit_return(JitFrame *f, int src)
+{
+    f->result = std::move(f->slots[src]);
+}
+
+// The step Op::JUMP takes going back. Returns nonzero, with the result
+// set, if the budget has run out.
+static int jit_step(JitFrame *f)
+{
+    if (f->interp->budget.step()) return 0;
+    f->result = f->interp->stopped(f->c->shared_from_this());
+    return 1;
+}
+
+static void store_result(JitFrame *f, int dst, ValuePtr r)
+{
+    if (r && r->type == Value::EXCEPTION) r = f->c->wrap_exception(r);
+    f->slots[dst] = std::move(r);
+}
+
+// Same as Op::RESOLVE. Returns nonzero if the call was completed here.
+static int jit_resolve(JitFrame *f, int k, int p, int dst)
+{
+    ContextPtr c = f->c->shared_from_this();
+    PendingCall& call(static_cast<PendingCall *>(f->pending)[p]);
+    ListValuePtr node = static_pointer_cast<ListValue>(f->consts[k]);
+    SymbolValuePtr name = static_pointer_cast<SymbolValue>(node->get(0));
+    ValuePtr func = f->interp->resolve_function(name, c, call.exec_context, call.func_context, node.get());
+    if (func->type == Value::EXCEPTION) {
+        store_result(f, dst, func);
+        return 1;
+    }
+    if (func->quote) {
+        store_result(f, dst, f->interp->apply_function(func, node->sub(1), c, call.exec_context, call.func_context));
+        call = PendingCall();
+        return 1;
+    }
+    call.func = func;
+    return 0;
+}
+
+// Same as Op::CALL; the result replaces the first argument slot
+static void jit_call(JitFrame *f, int p, int first, int argc)
+{
+    ContextPtr c = f->c->shared_from_this();
+    PendingCall call(std::move(static_cast<PendingCall *>(f->pending)[p]));
+    OperatorValue *ov = OperatorValue::with_arity(call.func, argc);
+    if (ov) {
+        ValuePtr a[3];
+        for (int i=0; i<argc; i++) a[i] = std::move(f->slots[first+i]);
+        store_result(f, first, ov->call(a, argc, c));
+        return;
+    }
+    if (call.func->type == Value::FUNC) {
+        // Params are bound straight from the argument slots
+        FunctionValuePtr fv = static_pointer_cast<FunctionValue>(call.func);
+        if (fv->memo) {
+            ValuePtr r = f->interp->call_memo(fv, f->slots + first, argc, c, call.exec_context, call.func_context);
+            for (int i=0; i<argc; i++) f->slots[first+i].reset();
+            store_result(f, first, r);
+            return;
+        }
+        ContextPtr nc;
+        ValuePtr r = f->interp->enter_function(fv, f->slots + first, argc, c, call.exec_context, call.func_context, nc);
+        for (int i=0; i<argc; i++) f->slots[first+i].reset();
+        store_result(f, first, r ? r : f->interp->run_body(fv, nc));
+        return;
+    }
+    ListValuePtr args = ListValue::make();
+    for (int i=0; i<argc; i++) args->append(std::move(f->slots[first+i]));
+    store_result(f, first, f->interp->apply_function(call.func, args, c, call.exec_context, call.func_context));
+}
+
+// Same as Op::TAIL_CALL. Where the VM would replace the frame, enters the
+// callee in place of this one and returns nonzero, and the native code
+// leaves for JitCode::run to run it. Otherwise the same as jit_call.
+static int jit_tail_call(JitFrame *f, int p, int first, int argc)
+{
+    PendingCall& call(static_cast<PendingCall *>(f->pending)[p]);
+    FunctionValue *fv = call.func->type == Value::FUNC ? static_cast<FunctionValue *>(call.func.get()) : 0;
+    if (!fv || fv->memo || !f->locals || f->c->type != Symbol::func_symbol) {
+        jit_call(f, p, first, argc);
+        return 0;
+    }
+    FunctionValuePtr func = static_pointer_cast<FunctionValue>(call.func);
+    CodePtr callee = f->interp->function_code(func);
+    if (!callee || callee->uses_context_paths) {
+        jit_call(f, p, first, argc);
+        return 0;
+    }
+    ContextPtr c = f->c->shared_from_this();
+    PendingCall taken(std::move(call));
+    ContextPtr nc;
+    ValuePtr err = f->interp->enter_function(func, f->slots + first, argc, c, taken.exec_context, taken.func_context, nc, true);
+    for (int i=0; i<argc; i++) f->slots[first+i].reset();
+    if (err) {
+        store_result(f, first, err);
+        return 0;
+    }
+    f->tail_func = std::move(func);
+    f->tail_context = std::move(nc);
+    return 1;
+}
+
+// Guarded operator whose operands didn't match the inline path
+static void jit_apply_target(JitFrame *f, int t, int first)
+{
+    ContextPtr c = f->c->shared_from_this();
+    ValuePtr a = std::move(f->slots[first]);
+    ValuePtr b = std::move(f->slots[first+1]);
+    store_result(f, first, static_cast<const OperatorValue *>(f->targets[t].get())->oper2(a, b, c));
+}
+
+// Same as Op::JUMP_IF_NOT: 1 to jump for false, 2 for an exception
+static int jit_jump_if_not(JitFrame *f, int src)
+{
+    ValuePtr v = std::move(f->slots[src]);
+    if (v && v->type == Value::EXCEPTION) {
+        f->slots[src] = f->c->wrap_exception(v);
+        return 2;
+    }
+    return (!v || !v.as_bool()) ? 1 : 0;
+}
+
+// Same as Op::JUMP_IF_EXC, or Op::CHECK_VALUE if nulls is set. Returns
+// nonzero to jump.
+static int jit_check_value(JitFrame *f, int src, int nulls)
+{
+    ValuePtr& v(f->slots[src]);
+    if (v && v->type == Value::EXCEPTION) {
+        v = f->c->wrap_exception(v);
+        return 1;
+    }
+    if (!v && nulls) {
+        v = ExceptionValue::make("Illegal null reference", f->c->shared_from_this());
+        return 1;
+    }
+    return 0;
+}
+
+static void jit_nip(JitFrame *f, int n, int top)
+{
+    f->slots[top-n] = std::move(f->slots[top]);
+    for (int i=top-n+1; i<=top; i++) f->slots[i].reset();
+}
+
+static void jit_for_prep(JitFrame *f, int first)
+{
+    ValuePtr *s = f->slots + first;
+    s[0] = IntValue::make(s[0].as_int());
+    s[1] = IntValue::make(s[1].as_int());
+    s[3] = NoneValue::make();
+}
+
+// Same as Op::FOR_NEXT. Returns nonzero at the end.
+static int jit_for_next(JitFrame *f, int k, int first)
+{
+    ValuePtr *s = f->slots + first;
+    int64_t& counter(s[0].imm.ival);
+    if (counter >= s[1].ival()) return 1;
+    bind_counter(f->c->vars, static_cast<const SymbolValue *>(f->consts[k].get())->sym->first()->sym, s[2], counter++);
+    return 0;
+}
+
+// Same as Op::EACH_PREP. Returns nonzero if the value isn't a list.
+static int jit_each_prep(JitFrame *f, int first)
+{
+    ValuePtr *s = f->slots + first;
+    if (s[0]->type != Value::LIST && s[0]->type != Value::INFIX) {
+        s[0] = ExceptionValue::make("Expected list type for: ", s[0], f->c->shared_from_this());
+        return 1;
+    }
+    s[1] = IntValue::make(0);
+    s[2] = NoneValue::make();
+    return 0;
+}
+
+// Same as Op::EACH_NEXT. Returns nonzero at the end of the list.
+static int jit_each_next(JitFrame *f, int k, int first)
+{
+    ValuePtr *s = f->slots + first;
+    ListValue *items = static_cast<ListValue *>(s[0].get());
+    int64_t& index(s[1].imm.ival);
+    if (index >= items->size()) return 1;
+    f->c->vars.set(static_cast<const SymbolValue *>(f->consts[k].get())->sym->first()->sym, items->get(index++));
+    return 0;
+}
+
+#ifdef SQUIRREL_JIT
+
+// Just enough of an x86-64 encoder for the templates below.
+// rbx holds the JitFrame pointer for the whole function.
+struct Assembler {
+    std::vector<uint8_t> buf;
+
+    void byte(uint8_t b) { buf.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs) { buf.insert(buf.end(), bs); }
+    void imm32(int32_t v) { for (int i=0; i<4; i++) byte((v >> (i*8)) & 0xff); }
+    void imm64(uint64_t v) { for (int i=0; i<8; i++) byte((v >> (i*8)) & 0xff); }
+    int here() const { return buf.size(); }
+
+    void patch32(int at, int32_t v) { memcpy(&buf[at], &v, 4); }
+
+    void prologue() { bytes({0x53, 0x48, 0x89, 0xfb}); }        // push rbx; mov rbx, rdi
+    void epilogue() { bytes({0x5b, 0xc3}); }                    // pop rbx; ret
+
+    // Call helper(frame, a, b, c, d) with integer immediates
+    void call(const void *fn, int nargs, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0) {
+        bytes({0x48, 0x89, 0xdf});                              // mov rdi, rbx
+        if (nargs > 0) { byte(0xbe); imm32(a); }                // mov esi, a
+        if (nargs > 1) { byte(0xba); imm32(b); }                // mov edx, b
+        if (nargs > 2) { byte(0xb9); imm32(c); }                // mov ecx, c
+        if (nargs > 3) { bytes({0x41, 0xb8}); imm32(d); }       // mov r8d, d
+        bytes({0x48, 0xb8}); imm64(reinterpret_cast<uint64_t>(fn)); // mov rax, fn
+        bytes({0xff, 0xd0});                                    // call rax
+    }
+
+    // Jumps return the offset of their rel32 field for patching
+    int jmp() { byte(0xe9); imm32(0); return here() - 4; }
+    int jcc(uint8_t cc) { bytes({0x0f, cc}); imm32(0); return here() - 4; }
+    void bind(int fixup, int target) { patch32(fixup, target - (fixup + 4)); }
+
+    static constexpr uint8_t JO = 0x80, JE = 0x84, JNE = 0x85, JL = 0x8c;
+};
+
+static int value_type_offset, imm_offset;
+static bool layout_checked, layout_ok;
+
+// The inline paths read ValuePtr and Value fields directly, so check that
+// the object pointer is the first word and the payload the second. An
+// immediate's prototype is frozen, so it is written over without a release.
+static bool check_layout()
+{
+    if (layout_checked) return layout_ok;
+    layout_checked = true;
+    ValuePtr probe = IntValue::make(12345);
+    Value **words = reinterpret_cast<Value **>(&probe);
+    value_type_offset = reinterpret_cast<char *>(&probe->type) - reinterpret_cast<char *>(probe.get());
+    imm_offset = reinterpret_cast<char *>(&probe.imm) - reinterpret_cast<char *>(&probe);
+
+    PendingCall call;
+    call.func = probe;
+    ValuePtr *func_field = &call.func;
+    layout_ok = sizeof(ValuePtr) == 2*sizeof(void *) && imm_offset == sizeof(void *) &&
+        words[0] == probe.get() && *reinterpret_cast<Value **>(func_field) == probe.get();
+    return layout_ok;
+}
+
+// Returns the operator a call node would reach, if the head is a plain
+// global symbol bound to a two-operand operator with a kernel.
+static OperatorValuePtr guarded_kernel(ListValuePtr node, ContextPtr global, SymbolPtr& sym)
+{
+    if (node->size() != 3) return 0;
+    SymbolValuePtr name = static_pointer_cast<SymbolValue>(node->get(0));
+    IdentifierPtr id = name->sym;
+    if (id->has_next() || id->first()->has_index()) return 0;
+    sym = id->first()->sym;
+    if (sym->local_binding) return 0;
+    auto i = global->vars.entries.find(sym->code);
+    if (i == global->vars.entries.end()) return 0;
+    ValuePtr v = i->second.second;
+    if (!v || v->type != Value::OPER || v->quote) return 0;
+    OperatorValuePtr ov = static_pointer_cast<OperatorValue>(v);
+    if (ov->kernel == OpKernel::NONE) return 0;
+    return ov;
+}
+
+struct PendingSite {
+    int p;              // pending call index
+    int slot;           // first argument slot
+    int target = -1;    // inline kernel target, if guarded
+    uint8_t kernel = 0;
+    int skip_fixup;     // RESOLVE's jump past the call
+    int guard_fixup[2] = {-1, -1};
+};
+
+// Inline INT fast path on slots (first, first+1), result in first. Both
+// operands are immediates, so the result is written straight over them.
+static void emit_kernel(Assembler& as, const PendingSite& site)
+{
+    int a = site.slot * sizeof(ValuePtr);
+    int b = a + sizeof(ValuePtr);
+    std::vector<int> slow;
+
+    as.bytes({0x48, 0x8b, 0x83}); as.imm32(offsetof(JitFrame, slots));   // mov rax, [rbx+slots]
+    as.bytes({0x48, 0x8b, 0x88}); as.imm32(a);                           // mov rcx, [rax+a]
+    as.bytes({0x48, 0x8b, 0x90}); as.imm32(b);                           // mov rdx, [rax+b]
+    as.bytes({0x48, 0x85, 0xc9}); slow.push_back(as.jcc(Assembler::JE)); // test rcx, rcx
+    as.bytes({0x48, 0x85, 0xd2}); slow.push_back(as.jcc(Assembler::JE)); // test rdx, rdx
+    as.bytes({0x80, 0xb9}); as.imm32(value_type_offset); as.byte(Value::INT); // cmp byte [rcx+type], INT
+    slow.push_back(as.jcc(Assembler::JNE));
+    as.bytes({0x80, 0xba}); as.imm32(value_type_offset); as.byte(Value::INT); // cmp byte [rdx+type], INT
+    slow.push_back(as.jcc(Assembler::JNE));
+    as.bytes({0x48, 0x8b, 0xb0}); as.imm32(a + imm_offset);             // mov rsi, [rax+a+imm]
+    as.bytes({0x48, 0x8b, 0xb8}); as.imm32(b + imm_offset);             // mov rdi, [rax+b+imm]
+
+    bool is_bool = false;
+    switch (site.kernel) {
+    case OpKernel::ADD: as.bytes({0x48, 0x01, 0xfe}); break;            // add rsi, rdi
+    case OpKernel::SUB: as.bytes({0x48, 0x29, 0xfe}); break;            // sub rsi, rdi
+    case OpKernel::MUL: as.bytes({0x48, 0x0f, 0xaf, 0xf7}); break;      // imul rsi, rdi
+    default: {
+        uint8_t setcc = 0;
+        switch (site.kernel) {
+        case OpKernel::LT: setcc = 0x9c; break;                         // setl
+        case OpKernel::GT: setcc = 0x9f; break;                         // setg
+        case OpKernel::LE: setcc = 0x9e; break;                         // setle
+        case OpKernel::GE: setcc = 0x9d; break;                         // setge
+        case OpKernel::EQ: setcc = 0x94; break;                         // sete
+        case OpKernel::NE: setcc = 0x95; break;                         // setne
+        }
+        as.bytes({0x48, 0x39, 0xfe});                                   // cmp rsi, rdi
+        as.bytes({0x0f, setcc, 0xc1});                                  // setcc cl
+        as.bytes({0x0f, 0xb6, 0xf1});                                   // movzx esi, cl
+        is_bool = true;
+    }
+    }
+    if (!is_bool) slow.push_back(as.jcc(Assembler::JO));
+    // The operator redoes an overflowed result on the slow path, as a BigInt
+
+    const Value *proto = is_bool ? (const Value *)&BoolValue::prototype[0] : (const Value *)&IntValue::prototype[0];
+    as.bytes({0x48, 0xb9}); as.imm64(reinterpret_cast<uint64_t>(proto)); // mov rcx, proto
+    as.bytes({0x48, 0x89, 0x88}); as.imm32(a);                          // mov [rax+a], rcx
+    as.bytes({0x48, 0x89, 0xb0}); as.imm32(a + imm_offset);             // mov [rax+a+imm], rsi
+    as.bytes({0x48, 0xc7, 0x80}); as.imm32(b); as.imm32(0);             // mov qword [rax+b], 0
+    as.bytes({0x48, 0xc7, 0x80}); as.imm32(b + imm_offset); as.imm32(0); // mov qword [rax+b+imm], 0
+    int done = as.jmp();
+
+    for (int f : slow) as.bind(f, as.here());
+    as.call((void *)jit_apply_target, 2, site.target, site.slot);
+    as.bind(done, as.here());
+}
+
+// A tail call that leaves sets no result, so it goes out the same way as
+// a stop
+static void emit_call(Assembler& as, const Instr& in, const PendingSite& site, std::vector<int>& stops)
+{
+    if (in.op == Op::TAIL_CALL) {
+        as.call((void *)jit_tail_call, 3, site.p, site.slot, in.b);
+        as.bytes({0x85, 0xc0});                                 // test eax, eax
+        stops.push_back(as.jcc(Assembler::JNE));
+    } else {
+        as.call((void *)jit_call, 3, site.p, site.slot, in.b);
+    }
+}
+
+JitCodePtr JitCode::compile(CodePtr code, ContextPtr global)
+{
+    if (!available()) return 0;
+
+    JitCodePtr jc = make_ref<JitCode>();
+    jc->code = code;
+    Assembler as;
+    as.prologue();
+
+    const std::vector<Instr>& ops(code->ops);
+    std::vector<int> labels(ops.size() + 1, -1);
+    std::vector<int> label_depth(ops.size() + 1, -1);
+    std::vector<std::pair<int, int>> fixups;   // (rel32 offset, instruction index)
+    std::vector<int> stops;                     // rel32 offsets of jumps out for jit_step
+    std::vector<PendingSite> sites;
+    int depth = 0, max_depth = 0, max_pending = 0;
+
+    for (int pc=0; pc<ops.size(); pc++) {
+        labels[pc] = as.here();
+        // Code after an unconditional jump is only reached by jumping to it
+        if (pc > 0 && (ops[pc-1].op == Op::JUMP || ops[pc-1].op == Op::RETURN) && label_depth[pc] >= 0) {
+            depth = label_depth[pc];
+        }
+        const Instr& in(ops[pc]);
+        switch (in.op) {
+        case Op::CONST:
+            as.call((void *)jit_const, 2, in.a, depth++);
+            break;
+        case Op::LOAD:
+            as.call((void *)jit_load, 2, in.a, depth++);
+            break;
+        case Op::LOAD_LOCAL:
+            as.call((void *)jit_load_local, 3, in.a, in.b, depth++);
+            break;
+        case Op::LOAD_GLOBAL:
+            as.call((void *)jit_load_global, 3, in.a, in.b, depth++);
+            break;
+        case Op::EVAL:
+            as.call((void *)jit_eval, 2, in.a, depth++);
+            break;
+        case Op::POP:
+            as.call((void *)jit_pop, 1, --depth);
+            break;
+        case Op::RETURN:
+            as.call((void *)jit_return, 1, depth - 1);
+            as.epilogue();
+            break;
+        case Op::RESOLVE: {
+            PendingSite site;
+            site.p = sites.size();
+            site.slot = depth;
+            SymbolPtr sym;
+            OperatorValuePtr ov = guarded_kernel(static_pointer_cast<ListValue>(code->consts[in.a]), global, sym);
+            if (ov) {
+                // Guard: symbol unchanged since compile and stack depth
+                // allowed. Then the step resolve_function would take.
+                site.kernel = ov->kernel;
+                site.target = jc->targets.size();
+                jc->targets.push_back(ov);
+                jc->guards.push_back(sym);
+                as.bytes({0x48, 0xb8}); as.imm64(reinterpret_cast<uint64_t>(&sym->version)); // mov rax, &version
+                as.bytes({0x81, 0x38}); as.imm32(sym->version);                                // cmp dword [rax], version
+                int miss = as.jcc(Assembler::JNE);
+                as.bytes({0x83, 0xbb}); as.imm32(offsetof(JitFrame, depth_ok)); as.byte(0);  // cmp dword [rbx+depth_ok], 0
+                int miss2 = as.jcc(Assembler::JE);
+                as.bytes({0x48, 0x8b, 0x83}); as.imm32(offsetof(JitFrame, steps_left));      // mov rax, [rbx+steps_left]
+                as.bytes({0x48, 0x83, 0x28, 0x01});                                            // sub qword [rax], 1
+                int miss3 = as.jcc(Assembler::JL);
+                int skip = as.jmp();
+                as.bind(miss, as.here());
+                as.bind(miss2, as.here());
+                as.bind(miss3, as.here());
+                as.call((void *)jit_resolve, 3, in.a, site.p, depth);
+                as.bytes({0x85, 0xc0});                                                        // test eax, eax
+                site.skip_fixup = as.jcc(Assembler::JNE);
+                as.bind(skip, as.here());
+            } else {
+                as.call((void *)jit_resolve, 3, in.a, site.p, depth);
+                as.bytes({0x85, 0xc0});                                                        // test eax, eax
+                site.skip_fixup = as.jcc(Assembler::JNE);
+            }
+            fixups.push_back({site.skip_fixup, in.b});
+            sites.push_back(site);
+            if (sites.size() > max_pending) max_pending = sites.size();
+            break;
+        }
+        case Op::CALL:
+        case Op::TAIL_CALL: {
+            PendingSite site = sites.back();
+            sites.pop_back();
+            if (site.target >= 0) {
+                // Pending func set means the guard failed and we resolved generically
+                int off = offsetof(JitFrame, pending);
+                as.bytes({0x48, 0x8b, 0x83}); as.imm32(off);                                   // mov rax, [rbx+pending]
+                as.bytes({0x48, 0x83, 0xb8}); as.imm32(site.p * sizeof(PendingCall)); as.byte(0); // cmp qword [rax+p], 0
+                int generic = as.jcc(Assembler::JNE);
+                emit_kernel(as, site);
+                int done = as.jmp();
+                as.bind(generic, as.here());
+                emit_call(as, in, site, stops);
+                as.bind(done, as.here());
+            } else {
+                emit_call(as, in, site, stops);
+            }
+            depth = site.slot + 1;
+            break;
+        }
+        case Op::JUMP:
+            if (in.a <= pc) {
+                as.call((void *)jit_step, 0);
+                as.bytes({0x85, 0xc0});                                                        // test eax, eax
+                stops.push_back(as.jcc(Assembler::JNE));
+            }
+            fixups.push_back({as.jmp(), in.a});
+            label_depth[in.a] = depth;
+            break;
+        case Op::JUMP_IF_NOT:
+            as.call((void *)jit_jump_if_not, 1, --depth);
+            as.bytes({0x83, 0xf8, 0x01});                                                      // cmp eax, 1
+            fixups.push_back({as.jcc(Assembler::JE), in.a});
+            as.bytes({0x83, 0xf8, 0x02});                                                      // cmp eax, 2
+            fixups.push_back({as.jcc(Assembler::JE), in.b});
+            label_depth[in.a] = depth;
+            label_depth[in.b] = depth + 1;
+            break;
+        case Op::JUMP_IF_EXC:
+        case Op::CHECK_VALUE:
+            as.call((void *)jit_check_value, 2, depth - 1, in.op == Op::CHECK_VALUE);
+            as.bytes({0x85, 0xc0});                                                            // test eax, eax
+            fixups.push_back({as.jcc(Assembler::JNE), in.a});
+            label_depth[in.a] = depth;
+            break;
+        case Op::NIP:
+            as.call((void *)jit_nip, 2, in.a, depth - 1);
+            depth -= in.a;
+            break;
+        case Op::FOR_PREP:
+            as.call((void *)jit_for_prep, 1, depth - 2);
+            depth += 2;
+            break;
+        case Op::FOR_NEXT:
+            as.call((void *)jit_for_next, 2, in.b, depth - 4);
+            as.bytes({0x85, 0xc0});                                                            // test eax, eax
+            fixups.push_back({as.jcc(Assembler::JNE), in.a});
+            label_depth[in.a] = depth;
+            break;
+        case Op::EACH_PREP:
+            as.call((void *)jit_each_prep, 1, depth - 1);
+            as.bytes({0x85, 0xc0});                                                            // test eax, eax
+            fixups.push_back({as.jcc(Assembler::JNE), in.a});
+            label_depth[in.a] = depth;
+            depth += 2;
+            break;
+        case Op::EACH_NEXT:
+            as.call((void *)jit_each_next, 2, in.b, depth - 3);
+            as.bytes({0x85, 0xc0});                                                            // test eax, eax
+            fixups.push_back({as.jcc(Assembler::JNE), in.a});
+            label_depth[in.a] = depth;
+            break;
+        default:
+            return 0;
+        }
+        if (depth > max_depth) max_depth = depth;
+    }
+    labels[ops.size()] = as.here();
+    for (auto& fx : fixups) as.bind(fx.first, labels[fx.second]);
+    if (!stops.empty()) {
+        for (int at : stops) as.bind(at, as.here());
+        as.epilogue();
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (as.buf.size() + page - 1) / page * page;
+    void *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return 0;
+    memcpy(mem, as.buf.data(), as.buf.size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return 0;
+    }
+    jc->mem = mem;
+    jc->size = size;
+    jc->entry = reinterpret_cast<jit_entry_f>(mem);
+    jc->num_slots = max_depth;
+    jc->num_pending = max_pending;
+    return jc;
+}
+
+JitCode::~JitCode()
+{
+    if (mem) munmap(mem, size);
+}
+
+bool JitCode::available()
+{
+    return check_layout();
+}
+
+#else
+
+JitCodePtr JitCode::compile(CodePtr code, ContextPtr global) { return 0; }
+JitCode::~JitCode() {}
+bool JitCode::available() { return false; }
+
+#endif
+
+// Tail calls come back here rather than nesting, so a chain of them runs
+// in constant native stack, as in the VM
+ValuePtr JitCode::run(Interpreter *interp, ContextPtr c)
+{
+    JitFrame f;
+    f.interp = interp;
+    enter(f, c);
+    FunctionValuePtr fv;
+    while (f.tail_func) {
+        fv = std::move(f.tail_func);
+        c = std::move(f.tail_context);
+        JitCode *jc = interp->function_jit(fv).get();
+        if (!jc) return interp->execute(interp->function_code(fv), c);
+        jc->enter(f, c);
+    }
+    return std::move(f.result);
+}
+
+void JitCode::enter(JitFrame& f, ContextPtr c)
+{
+    // Small frames live on the native stack
+    ValuePtr small_slots[16];
+    PendingCall small_pending[8];
+    std::unique_ptr<ValuePtr[]> big_slots;
+    std::unique_ptr<PendingCall[]> big_pending;
+
+    f.c = c.get();
+    f.consts = code->consts.data();
+    f.locals = (code->layout && c->vars.layout == code->layout) ? c->vars.slots.data() : 0;
+    f.globals = code->globals.data();
+    f.targets = targets.data();
+    f.steps_left = f.interp->budget.steps_left();
+    f.depth_ok = !f.interp->depth_exceeded(c);
+    if (num_slots <= 16) {
+        f.slots = small_slots;
+    } else {
+        big_slots.reset(new ValuePtr[num_slots]);
+        f.slots = big_slots.get();
+    }
+    if (num_pending <= 8) {
+        f.pending = small_pending;
+    } else {
+        big_pending.reset(new PendingCall[num_pending]);
+        f.pending = big_pending.get();
+    }
+    entry(&f);
+}
+
+}; // namespace squirrel
@@ -0,0 +1,57 @@
+#ifndef INCLUDED_SQUIRREL_JIT_HPP
+#define INCLUDED_SQUIRREL_JIT_HPP
+
+#include "compiler.hpp"
+
+namespace squirrel {
+
+// State shared between native code and the helpers it calls. Operand
+// stack positions are known at compile time, so each one is a fixed slot.
+struct JitFrame {
+    Interpreter *interp;
+    Context *c;
+    const ValuePtr *consts;
+    ValuePtr *slots;
+    ValuePtr *locals;
+    GlobalRef *globals;
+    void *pending;
+    const ValuePtr *targets;
+    int64_t *steps_left;
+    int depth_ok;
+    ValuePtr result;
+
+    // A tail call made by leaving native code, for JitCode::run to finish
+    FunctionValuePtr tail_func;
+    ContextPtr tail_context;
+};
+
+typedef void (*jit_entry_f)(JitFrame *frame);
+
+// Native translation of one Code object. Only built on x86-64 Linux; on
+// other hosts compile() returns null and callers stay on the bytecode VM.
+struct JitCode : public RefCounted {
+    CodePtr code;
+    void *mem = 0;
+    size_t size = 0;
+    jit_entry_f entry = 0;
+    int num_slots = 0;
+    int num_pending = 0;
+
+    // Guarded operators, indexed by the targets operand of the inline paths
+    std::vector<ValuePtr> targets;
+    std::vector<SymbolPtr> guards;
+
+    JitCode() { set_gc_kind(GcKind::JIT_CODE); }
+    ~JitCode();
+
+    static bool available();
+    static JitCodePtr compile(CodePtr code, ContextPtr global);
+    ValuePtr run(Interpreter *interp, ContextPtr c);
+
+private:
+    void enter(JitFrame& f, ContextPtr c);
+};
+
+}; // namespace squirrel
+
+#endif
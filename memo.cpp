@@ -0,0 +1,164 @@
+#include "interpreter.hpp"
+#include <bit>
+
+namespace squirrel {
+
+static void mix(size_t& h, uint64_t x)
+{
+    h = (h ^ x) * 0x100000001b3ull;
+}
+
+static bool hash_value(const ValuePtr& v, size_t& h)
+{
+    mix(h, v->type);
+    switch (v->type) {
+    case Value::NONE:
+        return true;
+    case Value::BOOL:
+        mix(h, v.bval());
+        return true;
+    case Value::INT:
+        mix(h, v.ival());
+        return true;
+    case Value::FLOAT:
+        mix(h, std::bit_cast<uint64_t>(v.fval()));
+        return true;
+    case Value::BIGINT: {
+        const BigInt& b(static_cast<const BigIntValue *>(v.get())->big);
+        mix(h, b.negative);
+        for (uint32_t d : b.mag) mix(h, d);
+        return true;
+    }
+    case Value::STR:
+        mix(h, static_cast<const StringValue *>(v.get())->sym->code);
+        return true;
+    case Value::LIST: {
+        const ListValue *l = static_cast<const ListValue *>(v.get());
+        const ValuePtr *items = l->items();
+        mix(h, l->size());
+        for (int i=0; i<l->size(); i++) {
+            if (!items[i] || !hash_value(items[i], h)) return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+// Same as far as keys go: floats compare by bits, so NaN finds itself
+static bool same_value(const ValuePtr& a, const ValuePtr& b)
+{
+    if (a == b) return true;
+    if (a->type != b->type) return false;
+    switch (a->type) {
+    case Value::NONE:
+        return true;
+    case Value::BOOL:
+        return a.bval() == b.bval();
+    case Value::INT:
+        return a.ival() == b.ival();
+    case Value::FLOAT:
+        return std::bit_cast<uint64_t>(a.fval()) == std::bit_cast<uint64_t>(b.fval());
+    case Value::BIGINT:
+        return BigInt::compare(static_cast<const BigIntValue *>(a.get())->big, static_cast<const BigIntValue *>(b.get())->big) == 0;
+    case Value::STR:
+        return static_cast<const StringValue *>(a.get())->sym->code == static_cast<const StringValue *>(b.get())->sym->code;
+    case Value::LIST: {
+        const ListValue *x = static_cast<const ListValue *>(a.get());
+        const ListValue *y = static_cast<const ListValue *>(b.get());
+        if (x->size() != y->size()) return false;
+        const ValuePtr *xi = x->items(), *yi = y->items();
+        for (int i=0; i<x->size(); i++) {
+            if (!same_value(xi[i], yi[i])) return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+// Lists can be changed in place after the call, so a key keeps its own copy
+static ValuePtr freeze(const ValuePtr& v)
+{
+    if (v->type != Value::LIST) return v;
+    const ListValue *l = static_cast<const ListValue *>(v.get());
+    ListValuePtr copy = ListValue::make();
+    copy->list.reserve(l->size());
+    for (int i=0; i<l->size(); i++) copy->append(freeze(l->items()[i]));
+    return copy;
+}
+
+bool MemoCache::KeyEqual::operator()(const MemoKey *a, const MemoKey *b) const
+{
+    if (a->hash != b->hash || a->args.size() != b->args.size()) return false;
+    for (size_t i=0; i<a->args.size(); i++) {
+        if (!same_value(a->args[i], b->args[i])) return false;
+    }
+    return true;
+}
+
+bool MemoCache::make_key(const ValuePtr *args, int n, MemoKey& key)
+{
+    key.hash = 0xcbf29ce484222325ull;
+    key.args.assign(args, args + n);
+    for (int i=0; i<n; i++) {
+        if (!args[i] || !hash_value(args[i], key.hash)) return false;
+    }
+    return true;
+}
+
+ValuePtr MemoCache::find(const MemoKey& key)
+{
+    auto i = index.find(&key);
+    if (i == index.end()) {
+        stats.misses++;
+        return 0;
+    }
+    stats.hits++;
+    entries.splice(entries.begin(), entries, i->second);
+    return i->second->second;
+}
+
+void MemoCache::insert(MemoKey key, ValuePtr result)
+{
+    // The body may have stored the same call already, by recursing
+    auto i = index.find(&key);
+    if (i != index.end()) {
+        i->second->second = result;
+        entries.splice(entries.begin(), entries, i->second);
+        return;
+    }
+    if (capacity == 0) return;
+    if (entries.size() >= capacity) {
+        index.erase(&entries.back().first);
+        entries.pop_back();
+        stats.evictions++;
+    }
+    for (ValuePtr& v : key.args) v = freeze(v);
+    entries.emplace_front(std::move(key), std::move(result));
+    index.emplace(&entries.front().first, entries.begin());
+}
+
+// Calls fv, which is memoized, with the n argument values in args. A call
+// found in the cache doesn't enter fv at all.
+ValuePtr Interpreter::call_memo(FunctionValuePtr fv, const ValuePtr *args, int n, ContextPtr caller, ContextPtr exec_context, ContextPtr func_context)
+{
+    // Held here in case the body replaces fv->memo
+    MemoCachePtr memo = fv->memo;
+    MemoKey key;
+    bool cacheable = MemoCache::make_key(args, n, key);
+    if (cacheable) {
+        ValuePtr r = memo->find(key);
+        if (r) return r;
+    } else {
+        memo->stats.uncacheable++;
+    }
+
+    ContextPtr c;
+    CHECK_EXCEPTION(enter_function(fv, args, n, caller, exec_context, func_context, c));
+    ValuePtr r = run_body(fv, c);
+    if (cacheable && r && r->type != Value::EXCEPTION) memo->insert(std::move(key), r);
+    return r;
+}
+
+}; // namespace squirrel
@@ -0,0 +1,63 @@
+#ifndef INCLUDED_SQUIRREL_MEMO_HPP
+#define INCLUDED_SQUIRREL_MEMO_HPP
+
+#include "value.hpp"
+#include <list>
+#include <unordered_map>
+
+namespace squirrel {
+
+// Evaluated arguments of one call of a memoized function. Only none, bool,
+// numbers, strings and lists of those can be keys; lists are compared by
+// their contents.
+struct MemoKey {
+    std::vector<ValuePtr> args;
+    size_t hash = 0;
+};
+
+struct MemoStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    // Calls with an argument that can't be a key, which always run the body
+    uint64_t uncacheable = 0;
+};
+
+// Results of a memoized function, least recently used evicted first.
+// Results that are exceptions or null aren't kept.
+struct MemoCache : public RefCounted {
+    typedef std::list<std::pair<MemoKey, ValuePtr>> Entries;
+
+    struct KeyHash {
+        size_t operator()(const MemoKey *k) const { return k->hash; }
+    };
+    struct KeyEqual {
+        bool operator()(const MemoKey *a, const MemoKey *b) const;
+    };
+
+    size_t capacity = 0;
+    MemoStats stats;
+    // Most recently used first; index points into it
+    Entries entries;
+    std::unordered_map<const MemoKey *, Entries::iterator, KeyHash, KeyEqual> index;
+
+    static constexpr size_t default_capacity = 1024;
+
+    MemoCache() { set_gc_kind(GcKind::MEMO); }
+
+    static MemoCachePtr make(size_t capacity) {
+        MemoCachePtr m = make_ref<MemoCache>();
+        m->capacity = capacity;
+        return m;
+    }
+
+    // Fills in key from the n values in args, false if one can't be a key
+    static bool make_key(const ValuePtr *args, int n, MemoKey& key);
+    ValuePtr find(const MemoKey& key);
+    void insert(MemoKey key, ValuePtr result);
+    size_t size() const { return entries.size(); }
+};
+
+}; // namespace squirrel
+
+#endif
@@ -1,13 +1,15 @@
 #include "interpreter.hpp"
+#include <cmath>
+#include <limits>
 
 namespace squirrel {
 
-typedef ValuePtr (*combine_f)(ValuePtr a, ValuePtr b);
+typedef ValuePtr (*combine_f)(const ValuePtr& a, const ValuePtr& b);
 
 static ValuePtr builtin_defun(ListValuePtr list, ContextPtr context)
 {    
     if (list->size() < 2) {
-        return ExceptionValue::make(std::string("func requires name and args arguments: ") + list->as_string(), context);
+        return ExceptionValue::make("func requires name and args arguments: ", list, context);
     }
     
     // std::cout << "name\n";
@@ -44,10 +46,17 @@ static ValuePtr builtin_list(ListValuePtr list, ContextPtr context)
     return list;
 }
 
+// The exception for running out of budget, which nothing catches or binds,
+// so that a stopped evaluation changes nothing after the point it stopped
+static bool is_stopped(const ValuePtr& v)
+{
+    return v && v->type == Value::EXCEPTION && static_cast<ExceptionValue *>(v.get())->stopped;
+}
+
 static ValuePtr builtin_set(ListValuePtr list, ContextPtr context)
 {
     if (list->size() < 2) {
-        return ExceptionValue::make(std::string("set requires name and value: ") + list->as_string(), context);
+        return ExceptionValue::make("set requires name and value: ", list, context);
     }
     
     SymbolValuePtr name = CAST_SYMBOL(list->get(0), context);
@@ -57,6 +66,7 @@ static ValuePtr builtin_set(ListValuePtr list, ContextPtr context)
     // ContextPtr owner = GET_CONTEXT(context->find_owner(name->sym, context, true), context);
     std::cout << "Going to eval\n";
     ValuePtr val = context->interp->evaluate(list->get(1), context);
+    if (is_stopped(val)) return val;
     CHECK_EXCEPTION(exec_context->set(name->sym->last(), val, context));
     return val;
 }
@@ -64,7 +74,7 @@ static ValuePtr builtin_set(ListValuePtr list, ContextPtr context)
 static ValuePtr builtin_set_obj(ListValuePtr list, ContextPtr context)
 {
     if (list->size() < 2) {
-        return ExceptionValue::make(std::string("set requires name and value: ") + list->as_string(), context);
+        return ExceptionValue::make("set requires name and value: ", list, context);
     }
     
     SymbolValuePtr name = CAST_SYMBOL(list->get(0), context);
@@ -76,11 +86,12 @@ static ValuePtr builtin_set_obj(ListValuePtr list, ContextPtr context)
         exec_context = exec_context->parent;
     }
     
-    if (!exec_context) return ExceptionValue::make(std::string("No object in scope: ") + list->as_string(), context);
+    if (!exec_context) return ExceptionValue::make("No object in scope: ", list, context);
     
     // ContextPtr owner = GET_CONTEXT(context->find_owner(name->sym, context, true), context);
     std::cout << "Going to eval\n";
     ValuePtr val = context->interp->evaluate(list->get(1), context);
+    if (is_stopped(val)) return val;
     CHECK_EXCEPTION(exec_context->set(name->sym->last(), val, context));
     return val;
 }
@@ -88,7 +99,7 @@ static ValuePtr builtin_set_obj(ListValuePtr list, ContextPtr context)
 static ValuePtr builtin_set_class(ListValuePtr list, ContextPtr context)
 {
     if (list->size() < 2) {
-        return ExceptionValue::make(std::string("set requires name and value: ") + list->as_string(), context);
+        return ExceptionValue::make("set requires name and value: ", list, context);
     }
     
     SymbolValuePtr name = CAST_SYMBOL(list->get(0), context);
@@ -100,11 +111,12 @@ static ValuePtr builtin_set_class(ListValuePtr list, ContextPtr context)
         exec_context = exec_context->parent;
     }
     
-    if (!exec_context) return ExceptionValue::make(std::string("No class in scope: ") + list->as_string(), context);
+    if (!exec_context) return ExceptionValue::make("No class in scope: ", list, context);
     
     // ContextPtr owner = GET_CONTEXT(context->find_owner(name->sym, context, true), context);
     std::cout << "Going to eval\n";
     ValuePtr val = context->interp->evaluate(list->get(1), context);
+    if (is_stopped(val)) return val;
     CHECK_EXCEPTION(exec_context->set(name->sym->last(), val, context));
     return val;
 }
@@ -112,15 +124,174 @@ static ValuePtr builtin_set_class(ListValuePtr list, ContextPtr context)
 static ValuePtr builtin_print(ListValuePtr list, ContextPtr context)
 {
     for (int i=0; i<list->size(); i++) {
-        std::cout << list->get(i) << std::endl;
+        *context->interp->output << list->get(i) << std::endl;
+    }
+    return NoneValue::make();
+}
+
+// memo f [capacity]: cache f's results by argument values, keeping the
+// capacity most recently used ones. A capacity of 0 stops memoizing f.
+static ValuePtr builtin_memo(ListValuePtr list, ContextPtr context)
+{
+    if (list->size() < 1) {
+        return ExceptionValue::make("memo requires a function: ", list, context);
+    }
+    FunctionValuePtr fv = CAST_FUNC(list->get(0), context);
+    int64_t capacity = MemoCache::default_capacity;
+    if (list->size() > 1) {
+        capacity = CAST_INT(list->get(1), context);
+        if (capacity < 0) {
+            return ExceptionValue::make("memo capacity must not be negative: ", list, context);
+        }
+    }
+    fv->memo = capacity ? MemoCache::make(capacity) : 0;
+    return fv;
+}
+
+// {hits misses evictions size} for a memoized function
+static ValuePtr builtin_memo_stats(ListValuePtr list, ContextPtr context)
+{
+    FunctionValuePtr fv = CAST_FUNC(list->get(0), context);
+    if (!fv->memo) return ExceptionValue::make("Function is not memoized: ", fv, context);
+    const MemoCache& m(*fv->memo);
+    ListValuePtr r = ListValue::make();
+    r->append(IntValue::make(m.stats.hits));
+    r->append(IntValue::make(m.stats.misses));
+    r->append(IntValue::make(m.stats.evictions));
+    r->append(IntValue::make(m.size()));
+    return r;
+}
+
+// gc: frees every reference cycle nothing else holds, returning the number
+// of objects freed
+static ValuePtr builtin_gc(ListValuePtr list, ContextPtr context)
+{
+    return IntValue::make(context->interp->collector.collect());
+}
+
+// {runs roots traced freed pending} for the interpreter's cycle collector
+static ValuePtr builtin_gc_stats(ListValuePtr list, ContextPtr context)
+{
+    const CycleCollector& gc(context->interp->collector);
+    ListValuePtr r = ListValue::make();
+    r->append(IntValue::make(gc.stats.runs));
+    r->append(IntValue::make(gc.stats.roots));
+    r->append(IntValue::make(gc.stats.traced));
+    r->append(IntValue::make(gc.stats.freed));
+    r->append(IntValue::make(gc.pending()));
+    return r;
+}
+
+// Control forms. Conditions and bodies run in the caller's context, so
+// loops don't make a frame per iteration. A loop's value is that of the
+// last body item run, or none; the first exception ends it. The compiler
+// turns these into jumps when the head is known to be the builtin.
+
+static ValuePtr builtin_if(ListValuePtr list, ContextPtr context)
+{
+    if (list->size() < 2) {
+        return ExceptionValue::make("if requires condition and body: ", list, context);
+    }
+
+    int n = list->size(), i = 0;
+    for (; i+1 < n; i += 2) {
+        ValuePtr cond = CHECK_EXCEPTION(context->interp->evaluate(list->get(i), context));
+        if (cond && cond.as_bool()) return context->interp->evaluate(list->get(i+1), context);
     }
+    if (i < n) return context->interp->evaluate(list->get(i), context);
     return NoneValue::make();
 }
 
+static ValuePtr builtin_while(ListValuePtr list, ContextPtr context)
+{
+    if (list->size() < 1) {
+        return ExceptionValue::make("while requires condition: ", list, context);
+    }
+
+    ValuePtr r = NoneValue::make();
+    for (;;) {
+        ValuePtr cond = CHECK_EXCEPTION(context->interp->evaluate(list->get(0), context));
+        if (!cond || !cond.as_bool()) return r;
+        for (int i=1; i<list->size(); i++) {
+            r = CHECK_EXCEPTION(context->interp->evaluate(list->get(i), context));
+        }
+    }
+}
+
+// for var start end body... counts from start up to, not including, end
+static ValuePtr builtin_for(ListValuePtr list, ContextPtr context)
+{
+    if (list->size() < 3) {
+        return ExceptionValue::make("for requires variable, start, and end: ", list, context);
+    }
+    SymbolPtr var = Compiler::plain_symbol(list->get(0), true);
+    if (!var) return ExceptionValue::make("for requires a plain variable name: ", list, context);
+
+    ValuePtr start = NULL_EXCEPTION(CHECK_EXCEPTION(context->interp->evaluate(list->get(1), context)), context);
+    ValuePtr end = NULL_EXCEPTION(CHECK_EXCEPTION(context->interp->evaluate(list->get(2), context)), context);
+
+    ValuePtr r = NoneValue::make();
+    ValuePtr last;
+    for (int64_t i = start.as_int(), e = end.as_int(); i < e; i++) {
+        bind_counter(context->vars, var, last, i);
+        for (int j=3; j<list->size(); j++) {
+            r = CHECK_EXCEPTION(context->interp->evaluate(list->get(j), context));
+        }
+    }
+    return r;
+}
+
+static ValuePtr builtin_each(ListValuePtr list, ContextPtr context)
+{
+    if (list->size() < 2) {
+        return ExceptionValue::make("each requires variable and list: ", list, context);
+    }
+    SymbolPtr var = Compiler::plain_symbol(list->get(0), true);
+    if (!var) return ExceptionValue::make("each requires a plain variable name: ", list, context);
+
+    ListValuePtr items = CAST_LIST(context->interp->evaluate(list->get(1), context), context);
+
+    ValuePtr r = NoneValue::make();
+    for (int i=0; i<items->size(); i++) {
+        context->vars.set(var, items->get(i));
+        for (int j=2; j<list->size(); j++) {
+            r = CHECK_EXCEPTION(context->interp->evaluate(list->get(j), context));
+        }
+    }
+    return r;
+}
+
+// try expr [name] handler... is the value of expr or, if that is an
+// exception, of the handler items, run with name bound to the exception.
+// With no handler, an exception gives none. Unless the exception is bound
+// to a name, expr runs untraced, since nothing can look at the trace.
+// Budget stops aren't caught.
+static ValuePtr builtin_try(ListValuePtr list, ContextPtr context)
+{
+    if (list->size() < 1) {
+        return ExceptionValue::make("try requires expression: ", list, context);
+    }
+    Interpreter *interp = context->interp;
+    SymbolPtr var = list->size() >= 3 ? Compiler::plain_symbol(list->get(1), true) : 0;
+
+    bool untraced = interp->untraced;
+    interp->untraced = !var;
+    ValuePtr r = interp->evaluate(list->get(0), context);
+    interp->untraced = untraced;
+    if (!r || r->type != Value::EXCEPTION || is_stopped(r)) return r;
+
+    if (var) context->vars.set(var, r);
+    r = NoneValue::make();
+    for (int i = var ? 2 : 1; i<list->size(); i++) {
+        r = CHECK_EXCEPTION(interp->evaluate(list->get(i), context));
+    }
+    return r;
+}
+
 static ValuePtr builtin_defclass(ListValuePtr list, ContextPtr context)
 {   
     if (list->size() < 1) {
-        return ExceptionValue::make(std::string("class requires name: ") + list->as_string(), context);
+        return ExceptionValue::make("class requires name: ", list, context);
     }
     
     SymbolValuePtr path_name = CAST_SYMBOL(list->get(0), context);
@@ -142,7 +313,14 @@ static ValuePtr builtin_defclass(ListValuePtr list, ContextPtr context)
     return cl;
 }
 
-static ValuePtr eq_two(ValuePtr a, ValuePtr b)
+// Any integer operand as a BigInt, for the paths that mix in BIGINT
+static BigInt big_of(const ValuePtr& v)
+{
+    if (v->type == Value::BIGINT) return static_cast<const BigIntValue *>(v.get())->big;
+    return BigInt(v.as_int());
+}
+
+static ValuePtr eq_two(const ValuePtr& a, const ValuePtr& b)
 {
     std::cout << "Comparing " << a << " and " << b << std::endl;
     if (a->type == Value::NONE && b->type == Value::NONE) return Value::TRUE;
@@ -190,12 +368,16 @@ static ValuePtr eq_two(ValuePtr a, ValuePtr b)
     
     if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
         std::cout << "Floats\n";
-        return a->as_float() == b->as_float() ? Value::TRUE : Value::FALSE;
+        return a.as_float() == b.as_float() ? Value::TRUE : Value::FALSE;
+    }
+    
+    if (a->type == Value::BIGINT || b->type == Value::BIGINT) {
+        return BigInt::compare(big_of(a), big_of(b)) == 0 ? Value::TRUE : Value::FALSE;
     }
     
     if (a->type == Value::INT || b->type == Value::INT) {
-        std::cout << "Ints " << a->as_int() << " and " << b->as_int() << "\n";
-        return a->as_int() == b->as_int() ? Value::TRUE : Value::FALSE;
+        std::cout << "Ints " << a.as_int() << " and " << b.as_int() << "\n";
+        return a.as_int() == b.as_int() ? Value::TRUE : Value::FALSE;
     }
     
     if (a->type == Value::BOOL || b->type == Value::BOOL) {
@@ -205,7 +387,7 @@ static ValuePtr eq_two(ValuePtr a, ValuePtr b)
     return Value::FALSE;
 }
 
-static ValuePtr lt_two(ValuePtr a, ValuePtr b)
+static ValuePtr lt_two(const ValuePtr& a, const ValuePtr& b)
 {
     if (a->type == Value::NONE && b->type == Value::NONE) return Value::FALSE;
     if (a->type == Value::NONE) {
@@ -259,11 +441,15 @@ static ValuePtr lt_two(ValuePtr a, ValuePtr b)
     }
     
     if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
-        return a->as_float() < b->as_float() ? Value::TRUE : Value::FALSE;
+        return a.as_float() < b.as_float() ? Value::TRUE : Value::FALSE;
+    }
+    
+    if (a->type == Value::BIGINT || b->type == Value::BIGINT) {
+        return BigInt::compare(big_of(a), big_of(b)) < 0 ? Value::TRUE : Value::FALSE;
     }
     
     if (a->type == Value::INT || b->type == Value::INT) {
-        return a->as_int() < b->as_int() ? Value::TRUE : Value::FALSE;
+        return a.as_int() < b.as_int() ? Value::TRUE : Value::FALSE;
     }
     
     if (a->type == Value::BOOL || b->type == Value::BOOL) {
@@ -274,125 +460,329 @@ static ValuePtr lt_two(ValuePtr a, ValuePtr b)
     return Value::FALSE;
 }
 
-static ValuePtr gt_two(ValuePtr a, ValuePtr b)
+static ValuePtr gt_two(const ValuePtr& a, const ValuePtr& b)
 {
     return lt_two(b, a);
 }
 
-static ValuePtr le_two(ValuePtr a, ValuePtr b)
+static ValuePtr le_two(const ValuePtr& a, const ValuePtr& b)
 {
     if (gt_two(a, b) == Value::TRUE) return Value::FALSE;
     return Value::TRUE;
 }
 
-static ValuePtr ge_two(ValuePtr a, ValuePtr b)
+static ValuePtr ge_two(const ValuePtr& a, const ValuePtr& b)
 {
     if (lt_two(a, b) == Value::TRUE) return Value::FALSE;
     return Value::TRUE;
 }
 
-static ValuePtr ne_two(ValuePtr a, ValuePtr b)
+static ValuePtr ne_two(const ValuePtr& a, const ValuePtr& b)
 {
     if (eq_two(a, b) == Value::TRUE) return Value::FALSE;
     return Value::TRUE;
 }
 
-static ValuePtr and_two_bitwise(ValuePtr a, ValuePtr b)
-{
-    return IntValue::make(a->as_int() & b->as_int());
-}
-
-static ValuePtr and_two_bool(ValuePtr a, ValuePtr b)
+static ValuePtr and_two_bitwise(const ValuePtr& a, const ValuePtr& b)
 {
-    return BoolValue::make(a->as_bool() && b->as_bool());
+    return IntValue::make(a.as_int() & b.as_int());
 }
 
-static ValuePtr or_two_bitwise(ValuePtr a, ValuePtr b)
+static ValuePtr or_two_bitwise(const ValuePtr& a, const ValuePtr& b)
 {
-    return IntValue::make(a->as_int() | b->as_int());
+    return IntValue::make(a.as_int() | b.as_int());
 }
 
-static ValuePtr or_two_bool(ValuePtr a, ValuePtr b)
+static ValuePtr or_two_bool(const ValuePtr& a, const ValuePtr& b)
 {
-    return BoolValue::make(a->as_bool() || b->as_bool());
+    return BoolValue::make(a.as_bool() || b.as_bool());
 }
 
-static ValuePtr xor_two_bitwise(ValuePtr a, ValuePtr b)
+static ValuePtr xor_two_bitwise(const ValuePtr& a, const ValuePtr& b)
 {
-    return IntValue::make(a->as_int() ^ b->as_int());
+    return IntValue::make(a.as_int() ^ b.as_int());
 }
 
 // static ValuePtr xor_two_bool(ValuePtr a, ValuePtr b)
 // {
-//     return BoolValue::make(a->as_bool() != b->as_bool());
+//     return BoolValue::make(a.as_bool() != b.as_bool());
 // }
 
 
-static ValuePtr cat_two(ValuePtr a, ValuePtr b)
+static ValuePtr cat_two(const ValuePtr& a, const ValuePtr& b)
+{
+    return StringValue::make(a.as_string() + b.as_string());
+}
+
+// Integer arithmetic on INT and BIGINT operands. Two INTs take the 64-bit
+// path, which checks for overflow; otherwise, or when it overflows, the
+// operation is redone with BigInt.
+
+static int64_t ival_of(const ValuePtr& v)
 {
-    return StringValue::make(a->as_string() + b->as_string());
+    return v.ival();
 }
 
-static ValuePtr add_two(ValuePtr a, ValuePtr b)
+static bool both_int(const ValuePtr& a, const ValuePtr& b)
 {
-    a = a->to_number(); b = b->to_number();
+    return a->type == Value::INT && b->type == Value::INT;
+}
+
+static ValuePtr int_add(const ValuePtr& a, const ValuePtr& b)
+{
+    int64_t r;
+    if (both_int(a, b) && !__builtin_add_overflow(ival_of(a), ival_of(b), &r)) return IntValue::make(r);
+    return BigIntValue::make(big_of(a) + big_of(b));
+}
+
+static ValuePtr int_sub(const ValuePtr& a, const ValuePtr& b)
+{
+    int64_t r;
+    if (both_int(a, b) && !__builtin_sub_overflow(ival_of(a), ival_of(b), &r)) return IntValue::make(r);
+    return BigIntValue::make(big_of(a) - big_of(b));
+}
+
+static ValuePtr int_mul(const ValuePtr& a, const ValuePtr& b)
+{
+    int64_t r;
+    if (both_int(a, b) && !__builtin_mul_overflow(ival_of(a), ival_of(b), &r)) return IntValue::make(r);
+    return BigIntValue::make(big_of(a) * big_of(b));
+}
+
+// Truncating, with the remainder taking the sign of a
+static ValuePtr int_divmod(const ValuePtr& a, const ValuePtr& b, bool want_quotient)
+{
+    if (b->type == Value::INT && ival_of(b) == 0) return ExceptionValue::make("Division by zero", 0);
+    if (both_int(a, b) && ival_of(b) != -1) {
+        return IntValue::make(want_quotient ? ival_of(a) / ival_of(b) : ival_of(a) % ival_of(b));
+    }
+    BigInt q, r;
+    BigInt::divmod(big_of(a), big_of(b), q, r);
+    return BigIntValue::make(want_quotient ? q : r);
+}
+
+// Past this many bits, ** gives a float instead
+static constexpr double max_pow_bits = 1 << 20;
+
+static ValuePtr int_pow(const ValuePtr& a, int64_t e)
+{
+    if (a->type == Value::INT) {
+        int64_t base = ival_of(a), r = 1;
+        bool overflow = false;
+        for (int64_t k = e; k && !overflow; ) {
+            if (k & 1) overflow = __builtin_mul_overflow(r, base, &r);
+            k >>= 1;
+            if (k && !overflow) overflow = __builtin_mul_overflow(base, base, &base);
+        }
+        if (!overflow) return IntValue::make(r);
+    }
+    BigInt base = big_of(a);
+    if (double(base.bits()) * e > max_pow_bits) return FloatValue::make(pow(a.as_float(), double(e)));
+    BigInt r(1);
+    for (int64_t k = e; k; k >>= 1) {
+        if (k & 1) r = r * base;
+        if (k > 1) base = base * base;
+    }
+    return BigIntValue::make(std::move(r));
+}
+
+static ValuePtr add_two(const ValuePtr& x, const ValuePtr& y)
+{
+    ValuePtr a = x.to_number(), b = y.to_number();
     if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
-        return FloatValue::make(a->as_float() + b->as_float());
+        return FloatValue::make(a.as_float() + b.as_float());
     } else {
-        return IntValue::make(a->as_int() + b->as_int());
+        return int_add(a, b);
     }
 }
 
-static ValuePtr mul_two(ValuePtr a, ValuePtr b)
+// + of two arguments, the same as reducing them from 0
+static ValuePtr sum_two(const ValuePtr& x, const ValuePtr& y)
 {
-    a = a->to_number(); b = b->to_number();
+    ValuePtr a = x.to_number(), b = y.to_number();
     if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
-        return FloatValue::make(a->as_float() * b->as_float());
+        return FloatValue::make((0.0 + a.as_float()) + b.as_float());
     } else {
-        return IntValue::make(a->as_int() * b->as_int());
+        return int_add(a, b);
     }
 }
 
-static ValuePtr sub_two(ValuePtr a, ValuePtr b)
+static ValuePtr mul_two(const ValuePtr& x, const ValuePtr& y)
 {
-    a = a->to_number(); b = b->to_number();
+    ValuePtr a = x.to_number(), b = y.to_number();
     if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
-        return FloatValue::make(a->as_float() - b->as_float());
+        return FloatValue::make(a.as_float() * b.as_float());
     } else {
-        return IntValue::make(a->as_int() - b->as_int());
+        return int_mul(a, b);
     }
 }
 
-static ValuePtr div_two(ValuePtr a, ValuePtr b)
+static ValuePtr sub_two(const ValuePtr& x, const ValuePtr& y)
 {
-    a = a->to_number(); b = b->to_number();
+    ValuePtr a = x.to_number(), b = y.to_number();
     if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
-        return FloatValue::make(a->as_float() / b->as_float());
+        return FloatValue::make(a.as_float() - b.as_float());
     } else {
-        return IntValue::make(a->as_int() / b->as_int());
+        return int_sub(a, b);
     }
 }
 
-static ValuePtr mod_two(ValuePtr a, ValuePtr b)
+static ValuePtr div_two(const ValuePtr& x, const ValuePtr& y)
 {
-    return IntValue::make(a->as_int() % b->as_int());
+    ValuePtr a = x.to_number(), b = y.to_number();
+    if (a->type == Value::FLOAT || b->type == Value::FLOAT) {
+        return FloatValue::make(a.as_float() / b.as_float());
+    } else {
+        return int_divmod(a, b, true);
+    }
+}
+
+static ValuePtr mod_two(const ValuePtr& x, const ValuePtr& y)
+{
+    return int_divmod(x.to_int(), y.to_int(), false);
+}
+
+static ValuePtr pow_two(const ValuePtr& x, const ValuePtr& y)
+{
+    ValuePtr a = x.to_number(), b = y.to_number();
+    if ((a->type == Value::INT || a->type == Value::BIGINT) && b->type == Value::INT && ival_of(b) >= 0) {
+        return int_pow(a, ival_of(b));
+    }
+    return FloatValue::make(pow(a.as_float(), b.as_float()));
 }
 
-static ValuePtr pow_two(ValuePtr a, ValuePtr b)
+// Type-pair dispatch. Each operator below has a table indexed by the types
+// of its two operands, filled in at compile time: INT and FLOAT pairs (and
+// STR pairs for comparisons) get a kernel that reads the values in place,
+// and every other entry is the general function above.
+
+constexpr int num_value_types = Value::BIGINT + 1;
+
+struct PairTable {
+    combine_f f[num_value_types][num_value_types];
+};
+
+template <int T> struct Operand;
+template <> struct Operand<Value::INT> {
+    static int64_t get(const ValuePtr& v) { return v.ival(); }
+};
+template <> struct Operand<Value::FLOAT> {
+    static double get(const ValuePtr& v) { return v.fval(); }
+};
+template <> struct Operand<Value::STR> {
+    static const std::string& get(const ValuePtr& v) { return static_cast<const StringValue *>(v.get())->sym->str; }
+};
+
+// Mixed INT and FLOAT operands are both taken as float, like as_float().
+// INT results that overflow go to the general function.
+template <class Op, combine_f general, bool compare, int A, int B>
+static ValuePtr pair_kernel(const ValuePtr& a, const ValuePtr& b)
 {
-    a = a->to_number(); b = b->to_number();
-    bool is_int = (a->type == Value::INT && b->type == Value::INT && CAST_INT(b, 0)->ival >= 0);
-    float af = a->as_float();
-    float bf = b->as_float();
-    float cf = pow(af, bf);
-    // std::cout << "af=" << af << " bf=" << bf << " cf=" << cf << std::endl;
-    if (is_int && isfinite(cf) && cf <= std::numeric_limits<int>::max() && cf >= std::numeric_limits<int>::min()) {
-        return IntValue::make(cf);
+    if constexpr (compare) {
+        if constexpr (A == B) {
+            return Op::apply(Operand<A>::get(a), Operand<B>::get(b)) ? Value::TRUE : Value::FALSE;
+        } else {
+            return Op::apply(double(Operand<A>::get(a)), double(Operand<B>::get(b))) ? Value::TRUE : Value::FALSE;
+        }
+    } else if constexpr (A == Value::INT && B == Value::INT) {
+        int64_t r;
+        if (Op::checked(Operand<A>::get(a), Operand<B>::get(b), r)) return IntValue::make(r);
+        return general(a, b);
     } else {
-        return FloatValue::make(cf);
+        return FloatValue::make(Op::apply(double(Operand<A>::get(a)), double(Operand<B>::get(b))));
+    }
+}
+
+namespace PairKinds {
+    enum {
+        INTS = 1,
+        FLOATS = 2,
+        STRS = 4,
+        NUMBERS = INTS | FLOATS
+    };
+};
+
+template <class Op, combine_f general, bool compare, int kinds>
+constexpr PairTable make_pair_table()
+{
+    PairTable t{};
+    for (auto& row : t.f) {
+        for (auto& e : row) e = general;
+    }
+    if constexpr ((kinds & PairKinds::INTS) != 0) {
+        t.f[Value::INT][Value::INT] = pair_kernel<Op, general, compare, Value::INT, Value::INT>;
+    }
+    if constexpr ((kinds & PairKinds::FLOATS) != 0) {
+        t.f[Value::INT][Value::FLOAT] = pair_kernel<Op, general, compare, Value::INT, Value::FLOAT>;
+        t.f[Value::FLOAT][Value::INT] = pair_kernel<Op, general, compare, Value::FLOAT, Value::INT>;
+        t.f[Value::FLOAT][Value::FLOAT] = pair_kernel<Op, general, compare, Value::FLOAT, Value::FLOAT>;
+    }
+    if constexpr ((kinds & PairKinds::STRS) != 0) {
+        t.f[Value::STR][Value::STR] = pair_kernel<Op, general, compare, Value::STR, Value::STR>;
     }
+    return t;
 }
 
+template <class Op, combine_f general, bool compare, int kinds>
+struct PairDispatch {
+    static constexpr PairTable table = make_pair_table<Op, general, compare, kinds>();
+    static ValuePtr call(const ValuePtr& a, const ValuePtr& b) {
+        return table.f[a->type][b->type](a, b);
+    }
+};
+
+// Each op is written the way the general function combines the converted
+// values, so that both give the same result. checked() is the INT x INT
+// case, which fails when the result needs the general function.
+struct AddOp {
+    static bool checked(int64_t a, int64_t b, int64_t& r) { return !__builtin_add_overflow(a, b, &r); }
+    static double apply(double a, double b) { return a + b; }
+};
+struct SumOp {
+    static bool checked(int64_t a, int64_t b, int64_t& r) { return !__builtin_add_overflow(a, b, &r); }
+    static double apply(double a, double b) { return (0.0 + a) + b; }
+};
+struct SubOp {
+    static bool checked(int64_t a, int64_t b, int64_t& r) { return !__builtin_sub_overflow(a, b, &r); }
+    static double apply(double a, double b) { return a - b; }
+};
+struct MulOp {
+    static bool checked(int64_t a, int64_t b, int64_t& r) { return !__builtin_mul_overflow(a, b, &r); }
+    static double apply(double a, double b) { return a * b; }
+};
+struct DivOp {
+    static bool checked(int64_t a, int64_t b, int64_t& r) { return b != 0 && b != -1 && (r = a / b, true); }
+    static double apply(double a, double b) { return a / b; }
+};
+struct ModOp {
+    static bool checked(int64_t a, int64_t b, int64_t& r) { return b != 0 && b != -1 && (r = a % b, true); }
+};
+struct AndOp { static bool checked(int64_t a, int64_t b, int64_t& r) { r = a & b; return true; } };
+struct OrOp { static bool checked(int64_t a, int64_t b, int64_t& r) { r = a | b; return true; } };
+struct XorOp { static bool checked(int64_t a, int64_t b, int64_t& r) { r = a ^ b; return true; } };
+struct EqOp { template <typename T> static bool apply(const T& a, const T& b) { return a == b; } };
+struct NeOp { template <typename T> static bool apply(const T& a, const T& b) { return !(a == b); } };
+struct LtOp { template <typename T> static bool apply(const T& a, const T& b) { return a < b; } };
+struct GtOp { template <typename T> static bool apply(const T& a, const T& b) { return b < a; } };
+struct LeOp { template <typename T> static bool apply(const T& a, const T& b) { return !(b < a); } };
+struct GeOp { template <typename T> static bool apply(const T& a, const T& b) { return !(a < b); } };
+
+typedef PairDispatch<AddOp, add_two, false, PairKinds::NUMBERS> add_pairs;
+typedef PairDispatch<SumOp, sum_two, false, PairKinds::NUMBERS> sum_pairs;
+typedef PairDispatch<SubOp, sub_two, false, PairKinds::NUMBERS> sub_pairs;
+typedef PairDispatch<MulOp, mul_two, false, PairKinds::NUMBERS> mul_pairs;
+typedef PairDispatch<DivOp, div_two, false, PairKinds::NUMBERS> div_pairs;
+typedef PairDispatch<ModOp, mod_two, false, PairKinds::INTS> mod_pairs;
+typedef PairDispatch<AndOp, and_two_bitwise, false, PairKinds::INTS> and_pairs;
+typedef PairDispatch<OrOp, or_two_bitwise, false, PairKinds::INTS> or_pairs;
+typedef PairDispatch<XorOp, xor_two_bitwise, false, PairKinds::INTS> xor_pairs;
+typedef PairDispatch<EqOp, eq_two, true, PairKinds::NUMBERS | PairKinds::STRS> eq_pairs;
+typedef PairDispatch<NeOp, ne_two, true, PairKinds::NUMBERS | PairKinds::STRS> ne_pairs;
+typedef PairDispatch<LtOp, lt_two, true, PairKinds::NUMBERS | PairKinds::STRS> lt_pairs;
+typedef PairDispatch<GtOp, gt_two, true, PairKinds::NUMBERS | PairKinds::STRS> gt_pairs;
+typedef PairDispatch<LeOp, le_two, true, PairKinds::NUMBERS | PairKinds::STRS> le_pairs;
+typedef PairDispatch<GeOp, ge_two, true, PairKinds::NUMBERS | PairKinds::STRS> ge_pairs;
+
 static ValuePtr oper_reduce_list(ListValuePtr list, ContextPtr context, ValuePtr initial, combine_f comb)
 {
     for (int i=0; i<list->size(); i++) {
@@ -417,17 +807,17 @@ static ValuePtr builtin_cat(ListValuePtr list, ContextPtr context)
 
 static ValuePtr builtin_add(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_list(list, context, Value::ZERO_INT, add_two);
+    return oper_reduce_list(list, context, Value::ZERO_INT, add_pairs::call);
 }
 
 static ValuePtr builtin_mul(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_list(list, context, Value::ONE_INT, mul_two);
+    return oper_reduce_list(list, context, Value::ONE_INT, mul_pairs::call);
 }
 
 static ValuePtr builtin_sub(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, sub_two);
+    return oper_reduce_two(list, context, sub_pairs::call);
 }
 
 static ValuePtr builtin_pow(ListValuePtr list, ContextPtr context)
@@ -437,57 +827,72 @@ static ValuePtr builtin_pow(ListValuePtr list, ContextPtr context)
 
 static ValuePtr builtin_div(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, div_two);
+    return oper_reduce_two(list, context, div_pairs::call);
 }
 
 static ValuePtr builtin_mod(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, mod_two);
+    return oper_reduce_two(list, context, mod_pairs::call);
 }
 
 static ValuePtr builtin_eq(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, eq_two);
+    return oper_reduce_two(list, context, eq_pairs::call);
 }
 
 static ValuePtr builtin_ne(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, ne_two);
+    return oper_reduce_two(list, context, ne_pairs::call);
 }
 
 static ValuePtr builtin_lt(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, lt_two);
+    return oper_reduce_two(list, context, lt_pairs::call);
 }
 
 static ValuePtr builtin_gt(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, gt_two);
+    return oper_reduce_two(list, context, gt_pairs::call);
 }
 
 static ValuePtr builtin_le(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, le_two);
+    return oper_reduce_two(list, context, le_pairs::call);
 }
 
 static ValuePtr builtin_ge(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_two(list, context, ge_two);
+    return oper_reduce_two(list, context, ge_pairs::call);
 }
 
 static ValuePtr builtin_and_bitwise(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_list(list, context, Value::NEGONE_INT, and_two_bitwise);
+    return oper_reduce_list(list, context, Value::NEGONE_INT, and_pairs::call);
 }
 
-static ValuePtr builtin_and_bool(ListValuePtr list, ContextPtr context)
+// Short-circuiting: arguments are lazy and are forced left to right only
+// until the result is decided
+static ValuePtr builtin_and_lazy(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_list(list, context, Value::TRUE, and_two_bool);
+    for (int i=0; i<list->size(); i++) {
+        ValuePtr v = CHECK_EXCEPTION(context->interp->force(list->get(i), context));
+        if (!v || !v.as_bool()) return Value::FALSE;
+    }
+    return Value::TRUE;
+}
+
+static ValuePtr builtin_or_lazy(ListValuePtr list, ContextPtr context)
+{
+    for (int i=0; i<list->size(); i++) {
+        ValuePtr v = CHECK_EXCEPTION(context->interp->force(list->get(i), context));
+        if (v && v.as_bool()) return Value::TRUE;
+    }
+    return Value::FALSE;
 }
 
 static ValuePtr builtin_or_bitwise(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_list(list, context, Value::ZERO_INT, or_two_bitwise);
+    return oper_reduce_list(list, context, Value::ZERO_INT, or_pairs::call);
 }
 
 static ValuePtr builtin_or_bool(ListValuePtr list, ContextPtr context)
@@ -497,7 +902,7 @@ static ValuePtr builtin_or_bool(ListValuePtr list, ContextPtr context)
 
 static ValuePtr builtin_xor_bitwise(ListValuePtr list, ContextPtr context)
 {
-    return oper_reduce_list(list, context, Value::ZERO_INT, xor_two_bitwise);
+    return oper_reduce_list(list, context, Value::ZERO_INT, xor_pairs::call);
 }
 
 // static ValuePtr builtin_xor_bool(ListValuePtr list, ContextPtr context)
@@ -505,36 +910,107 @@ static ValuePtr builtin_xor_bitwise(ListValuePtr list, ContextPtr context)
 //     return oper_reduce_list(list, context, Token::bool_false, xor_two_bool);
 // }
 
+// One-argument operators. The list forms give the value for no arguments
+// and ignore any past the first.
+
+static ValuePtr notzero_one(const ValuePtr& a, const ContextPtr& context)
+{
+    return a.to_bool();
+}
+
+static ValuePtr not_bool_one(const ValuePtr& a, const ContextPtr& context)
+{
+    ValuePtr c = a.to_bool();
+    if (c == Value::TRUE) return Value::FALSE;
+    return Value::TRUE;
+}
+
+static ValuePtr not_bitwise_one(const ValuePtr& a, const ContextPtr& context)
+{
+    return IntValue::make(~ a.as_int());
+}
+
+static ValuePtr neg_one(const ValuePtr& a, const ContextPtr& context)
+{
+    if (a->type == Value::FLOAT) {
+        return FloatValue::make(- a.as_float());
+    } else if (a->type == Value::BIGINT) {
+        return BigIntValue::make(- static_cast<const BigIntValue *>(a.get())->big);
+    } else {
+        int64_t x = a.as_int();
+        if (x == std::numeric_limits<int64_t>::min()) return BigIntValue::make(- BigInt(x));
+        return IntValue::make(- x);
+    }
+}
+
+static ValuePtr identity_one(const ValuePtr& a, const ContextPtr& context)
+{
+    return a;
+}
+
+static ValuePtr str_one(const ValuePtr& a, const ContextPtr& context)
+{
+    return a.to_string();
+}
+
+static ValuePtr int_one(const ValuePtr& a, const ContextPtr& context)
+{
+    return a.to_int();
+}
+
+static ValuePtr float_one(const ValuePtr& a, const ContextPtr& context)
+{
+    return a.to_float();
+}
+
+// An integral float as an integer; inf and nan stay floats
+static ValuePtr rounded(double cf)
+{
+    if (!std::isfinite(cf)) return FloatValue::make(cf);
+    if (cf >= -9223372036854775808.0 && cf < 9223372036854775808.0) return IntValue::make((int64_t)cf);
+    return BigIntValue::make(BigInt::from_double(cf));
+}
+
+static ValuePtr floor_one(const ValuePtr& a, const ContextPtr& context)
+{
+    if (a->type == Value::INT || a->type == Value::BIGINT) return a;
+    return rounded(floor(a.as_float()));
+}
+
+static ValuePtr ceil_one(const ValuePtr& a, const ContextPtr& context)
+{
+    if (a->type == Value::INT || a->type == Value::BIGINT) return a;
+    return rounded(ceil(a.as_float()));
+}
+
+static ValuePtr round_one(const ValuePtr& a, const ContextPtr& context)
+{
+    if (a->type == Value::INT || a->type == Value::BIGINT) return a;
+    return rounded(round(a.as_float()));
+}
+
 static ValuePtr builtin_notzero(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    return list->get(0)->to_bool();
+    return notzero_one(list->get(0), context);
 }
 
 static ValuePtr builtin_not_bool(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    ValuePtr c = list->get(0)->to_bool();
-    if (c == Value::TRUE) return Value::FALSE;
-    return Value::TRUE;
+    return not_bool_one(list->get(0), context);
 }
 
 static ValuePtr builtin_not_bitwise(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    ValuePtr c = list->get(0);
-    return IntValue::make(~ c->as_int());
+    return not_bitwise_one(list->get(0), context);
 }
 
 static ValuePtr builtin_neg(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    ValuePtr c = list->get(0);
-    if (c->type == Value::FLOAT) {
-        return FloatValue::make(- c->as_float());
-    } else {
-        return IntValue::make(- c->as_int());
-    }
+    return neg_one(list->get(0), context);
 }
 
 static ValuePtr builtin_identity(ListValuePtr list, ContextPtr context)
@@ -546,61 +1022,45 @@ static ValuePtr builtin_identity(ListValuePtr list, ContextPtr context)
 static ValuePtr builtin_str(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return Value::EMPTY_STR;
-    return list->get(0)->to_string();
+    return str_one(list->get(0), context);
 }
 
 static ValuePtr builtin_int(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return Value::ZERO_INT;
-    return list->get(0)->to_int();
+    return int_one(list->get(0), context);
 }
 
 static ValuePtr builtin_float(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return Value::ZERO_FLOAT;
-    return list->get(0)->to_float();
+    return float_one(list->get(0), context);
 }
 
 static ValuePtr builtin_floor(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    ValuePtr item = list->get(0);
-    if (item->type == Value::INT) return item;
-    
-    float cf = floor(item->as_float());
-    if (isfinite(cf) && cf <= std::numeric_limits<int>::max() && cf >= std::numeric_limits<int>::min()) {
-        return IntValue::make(cf);
-    } else {
-        return FloatValue::make(cf);
-    }
+    return floor_one(list->get(0), context);
 }
 
 static ValuePtr builtin_ceil(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    ValuePtr item = list->get(0);
-    if (item->type == Value::INT) return item;
-    
-    float cf = ceil(item->as_float());
-    if (isfinite(cf) && cf <= std::numeric_limits<int>::max() && cf >= std::numeric_limits<int>::min()) {
-        return IntValue::make(cf);
-    } else {
-        return FloatValue::make(cf);
-    }
+    return ceil_one(list->get(0), context);
 }
 
 static ValuePtr builtin_round(ListValuePtr list, ContextPtr context)
 {
     if (list->size() == 0) return NoneValue::make();
-    ValuePtr item = list->get(0);
-    if (item->type == Value::INT) return item;
-    
-    float cf = round(item->as_float());
-    if (isfinite(cf) && cf <= std::numeric_limits<int>::max() && cf >= std::numeric_limits<int>::min()) {
-        return IntValue::make(cf);
-    } else {
-        return FloatValue::make(cf);
-    }
+    return round_one(list->get(0), context);
+}
+
+// Two-argument entry point of an operator whose list form reduces with
+// comb; for two arguments both give the same value
+template <combine_f comb>
+static ValuePtr binary(const ValuePtr& a, const ValuePtr& b, const ContextPtr& context)
+{
+    return comb(a, b);
 }
 
 void Interpreter::load_operators() {
@@ -608,61 +1068,85 @@ void Interpreter::load_operators() {
     global->set(Symbol::make("false"), Value::FALSE);
     global->set(Symbol::make("none"), NoneValue::make());
     
-    add_operator("+", builtin_add, 4);
-    add_operator("-", builtin_sub, 4);
-    add_operator("*", builtin_mul, 3);
-    add_operator("/", builtin_div, 3);
-    add_operator("%", builtin_mod, 3);
-    add_operator("**", builtin_pow, 1, OpOrder::RASSOC);
-
-    add_operator("&", builtin_and_bitwise, 8);
-    add_operator("^", builtin_xor_bitwise, 9);
-    add_operator("|", builtin_or_bitwise, 10);
-    
-    add_operator("&&", builtin_and_bool, 11);
-    add_operator("and", builtin_and_bool, 11);
-    add_operator("||", builtin_or_bool, 12);
-    add_operator("or", builtin_or_bool, 12);
-    add_operator("xor", builtin_or_bool, 13);
-    add_operator("~", builtin_not_bitwise, 2, OpOrder::UNARY);
-    
-    add_operator("!!", builtin_notzero, 2, OpOrder::UNARY);
-    add_operator("!", builtin_not_bool, 2, OpOrder::UNARY);
-    add_operator("not", builtin_not_bool, 2, OpOrder::UNARY);
-    add_operator("neg", builtin_neg, 2, OpOrder::UNARY);
-    
-    add_operator("=", builtin_eq, 7);
-    add_operator("==", builtin_eq, 7);
-    add_operator("eq", builtin_eq, 7);
-    add_operator("<>", builtin_ne, 7);
-    add_operator("!=", builtin_ne, 7);
-    add_operator("ne", builtin_ne, 7);
-
-    add_operator("<", builtin_lt, 6);
-    add_operator(">", builtin_gt, 6);
-    add_operator("<=", builtin_le, 6);
-    add_operator(">=", builtin_ge, 6);
-    
-    add_operator("cat", builtin_cat, 0);
+    add_operator("+", builtin_add, binary<sum_pairs::call>, 4)->kernel = OpKernel::ADD;
+    add_operator("-", builtin_sub, binary<sub_pairs::call>, 4)->kernel = OpKernel::SUB;
+    add_operator("*", builtin_mul, binary<mul_pairs::call>, 3)->kernel = OpKernel::MUL;
+    add_operator("/", builtin_div, binary<div_pairs::call>, 3);
+    add_operator("%", builtin_mod, binary<mod_pairs::call>, 3);
+    add_operator("**", builtin_pow, binary<pow_two>, 1, OpOrder::RASSOC);
+
+    add_operator("&", builtin_and_bitwise, binary<and_pairs::call>, 8);
+    add_operator("^", builtin_xor_bitwise, binary<xor_pairs::call>, 9);
+    add_operator("|", builtin_or_bitwise, binary<or_pairs::call>, 10);
+    
+    auto short_circuit = [](OperatorValuePtr o, uint8_t control) {
+        o->lazy = ~0u;
+        o->control = control;
+    };
+    short_circuit(add_operator("&&", builtin_and_lazy, 11, 0, NoEval), ControlOp::AND);
+    short_circuit(add_operator("and", builtin_and_lazy, 11, 0, NoEval), ControlOp::AND);
+    short_circuit(add_operator("||", builtin_or_lazy, 12, 0, NoEval), ControlOp::OR);
+    short_circuit(add_operator("or", builtin_or_lazy, 12, 0, NoEval), ControlOp::OR);
+    add_operator("xor", builtin_or_bool, binary<or_two_bool>, 13);
+    add_operator("~", builtin_not_bitwise, not_bitwise_one, 2, OpOrder::UNARY);
+    
+    add_operator("!!", builtin_notzero, notzero_one, 2, OpOrder::UNARY);
+    add_operator("!", builtin_not_bool, not_bool_one, 2, OpOrder::UNARY);
+    add_operator("not", builtin_not_bool, not_bool_one, 2, OpOrder::UNARY);
+    add_operator("neg", builtin_neg, neg_one, 2, OpOrder::UNARY);
+    
+    add_operator("=", builtin_eq, binary<eq_pairs::call>, 7)->kernel = OpKernel::EQ;
+    add_operator("==", builtin_eq, binary<eq_pairs::call>, 7)->kernel = OpKernel::EQ;
+    add_operator("eq", builtin_eq, binary<eq_pairs::call>, 7)->kernel = OpKernel::EQ;
+    add_operator("<>", builtin_ne, binary<ne_pairs::call>, 7)->kernel = OpKernel::NE;
+    add_operator("!=", builtin_ne, binary<ne_pairs::call>, 7)->kernel = OpKernel::NE;
+    add_operator("ne", builtin_ne, binary<ne_pairs::call>, 7)->kernel = OpKernel::NE;
+
+    add_operator("<", builtin_lt, binary<lt_pairs::call>, 6)->kernel = OpKernel::LT;
+    add_operator(">", builtin_gt, binary<gt_pairs::call>, 6)->kernel = OpKernel::GT;
+    add_operator("<=", builtin_le, binary<le_pairs::call>, 6)->kernel = OpKernel::LE;
+    add_operator(">=", builtin_ge, binary<ge_pairs::call>, 6)->kernel = OpKernel::GE;
+    
+    add_operator("cat", builtin_cat, binary<cat_two>, 0);
     add_operator("print", builtin_print, 0);
+    add_operator("memo", builtin_memo, 0);
+    add_operator("memo-stats", builtin_memo_stats, 0);
+    add_operator("gc", builtin_gc, 0);
+    add_operator("gc-stats", builtin_gc_stats, 0);
     
     add_operator("func", builtin_defun, 0, 0, NoEval);
     add_operator("set", builtin_set, 0, 0, NoEval);
     add_operator("set@", builtin_set_obj, 0, 0, NoEval);
     add_operator("set@@", builtin_set_class, 0, 0, NoEval);
     add_operator("class", builtin_defclass, 0, 0, NoEval);
-
-    add_operator("identity", builtin_identity, 0, OpOrder::UNARY);
-    add_operator("int", builtin_int, 0, OpOrder::UNARY);
-    add_operator("float", builtin_float, 0, OpOrder::UNARY);
-    add_operator("floor", builtin_floor, 0, OpOrder::UNARY);
-    add_operator("ceil", builtin_ceil, 0, OpOrder::UNARY);
-    add_operator("round", builtin_round, 0, OpOrder::UNARY);
-    add_operator("str", builtin_str, 0, OpOrder::UNARY);
+    
+    add_operator("if", builtin_if, 0, 0, NoEval)->control = ControlOp::IF;
+    add_operator("while", builtin_while, 0, 0, NoEval)->control = ControlOp::WHILE;
+    add_operator("for", builtin_for, 0, 0, NoEval)->control = ControlOp::FOR;
+    add_operator("each", builtin_each, 0, 0, NoEval)->control = ControlOp::EACH;
+    add_operator("try", builtin_try, 0, 0, NoEval);
+
+    add_operator("identity", builtin_identity, identity_one, 0, OpOrder::UNARY);
+    add_operator("int", builtin_int, int_one, 0, OpOrder::UNARY);
+    add_operator("float", builtin_float, float_one, 0, OpOrder::UNARY);
+    add_operator("floor", builtin_floor, floor_one, 0, OpOrder::UNARY);
+    add_operator("ceil", builtin_ceil, ceil_one, 0, OpOrder::UNARY);
+    add_operator("round", builtin_round, round_one, 0, OpOrder::UNARY);
+    add_operator("str", builtin_str, str_one, 0, OpOrder::UNARY);
     add_operator("list", builtin_list, 0, OpOrder::UNARY);
     
     // add_operator("copy", builtin_shallow_copy, 0, Token::UNARY);
     // list -- turn args into list
+    
+    static const char *pure_operators[] = {
+        "+", "-", "*", "/", "%", "**", "&", "^", "|", "&&", "and", "||", "or", "xor",
+        "~", "!!", "!", "not", "neg", "=", "==", "eq", "<>", "!=", "ne", "<", ">", "<=", ">=",
+        "cat", "identity", "int", "float", "floor", "ceil", "round", "str"
+    };
+    for (const char *name : pure_operators) {
+        ValuePtr v = global->get(Symbol::make(name));
+        if (v->type == Value::OPER) static_cast<OperatorValue *>(v.get())->pure = true;
+    }
 }
 
 } // namespace squirrel
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "interpreter.hpp"
+
+namespace squirrel {
+
+typedef std::vector<std::pair<SymbolPtr, uint32_t>> Guards;
+
+static bool stale(const Guards& guards)
+{
+    for (const auto& g : guards) {
+        if (g.first->version != g.second) return true;
+    }
+    return false;
+}
+
+// What v, evaluated, can do. Call heads must be names bound only globally,
+// to pure operators, if/and/or, or pure functions; their symbols go into
+// guards when it is given.
+int Interpreter::arg_kind(const ValuePtr& v, Guards *guards, std::vector<FunctionValue *>& visiting)
+{
+    if (!v) return ArgKind::IMPURE;
+    if (v->quote) return ArgKind::CHEAP;
+    if (v->type == Value::SYM) return Compiler::plain_symbol(v) ? ArgKind::CHEAP : ArgKind::IMPURE;
+    if (v->type == Value::INFIX) {
+        ValuePtr e = infix_expr(static_pointer_cast<InfixValue>(v), global);
+        if (!e || e->type == Value::EXCEPTION) return ArgKind::IMPURE;
+        if (e == v) return ArgKind::CHEAP;
+        return arg_kind(e, guards, visiting);
+    }
+    if (v->type != Value::LIST) return ArgKind::CHEAP;
+
+    ListValue *l = static_cast<ListValue *>(v.get());
+    ValuePtr name = l->get(0);
+    if (name->type == Value::NONE) return ArgKind::CHEAP;
+    SymbolPtr head = Compiler::plain_symbol(name);
+    if (!head || head->local_binding) return ArgKind::IMPURE;
+    auto e = global->vars.entries.find(head->code);
+    if (e == global->vars.entries.end() || !e->second.second) return ArgKind::IMPURE;
+    ValuePtr f = e->second.second;
+
+    int kind = ArgKind::CHEAP;
+    if (f->type == Value::OPER) {
+        OperatorValue *ov = static_cast<OperatorValue *>(f.get());
+        if (!ov->pure && ov->control != ControlOp::IF) return ArgKind::IMPURE;
+    } else if (f->type == Value::FUNC) {
+        FunctionValue *fv = static_cast<FunctionValue *>(f.get());
+        bool pure = guards ? function_is_pure(fv, guards, visiting) : pure_function(fv);
+        if (fv->quote || !pure) return ArgKind::IMPURE;
+        kind = ArgKind::HEAVY;
+    } else {
+        return ArgKind::IMPURE;
+    }
+    if (guards) guards->push_back({head, head->version});
+
+    for (int i=1; i<l->size(); i++) {
+        int k = arg_kind(l->get(i), guards, visiting);
+        if (k == ArgKind::IMPURE) return k;
+        kind = std::max(kind, k);
+    }
+    return kind;
+}
+
+// Whether fv's body is pure, assuming that any function on visiting is
+bool Interpreter::function_is_pure(FunctionValue *fv, Guards *guards, std::vector<FunctionValue *>& visiting)
+{
+    if (fv->memo || !fv->params || !fv->body) return false;
+    for (FunctionValue *p : visiting) {
+        if (p == fv) return true;
+    }
+    // Workers bind params without laying them out first
+    if (!fv->layout) layout_params(fv);
+    if (!fv->slot_params) return false;
+
+    visiting.push_back(fv);
+    bool pure = true;
+    for (int i=0; i<fv->body->size() && pure; i++) {
+        pure = arg_kind(fv->body->get(i), guards, visiting) != ArgKind::IMPURE;
+    }
+    visiting.pop_back();
+    return pure;
+}
+
+// Purity of fv, cached until a head its body relies on is rebound. Only
+// whole analyses are cached: a function found pure while one it calls was
+// still being looked at is only pure if that one turns out to be.
+bool Interpreter::pure_function(FunctionValue *fv)
+{
+    if (fv->memo) return false;
+    if (fv->purity != Purity::UNKNOWN && !stale(fv->purity_guards)) return fv->purity == Purity::PURE;
+    std::vector<FunctionValue *> visiting;
+    fv->purity_guards.clear();
+    bool pure = function_is_pure(fv, &fv->purity_guards, visiting);
+    fv->purity = pure ? Purity::PURE : Purity::IMPURE;
+    return pure;
+}
+
+// Arguments of node, from index 1, are all pure and at least two of them
+// call user functions
+bool Interpreter::parallel_candidate(ListValue *node)
+{
+    int heavy = 0;
+    std::vector<FunctionValue *> visiting;
+    for (int i=1; i<node->size(); i++) {
+        int k = arg_kind(node->get(i), 0, visiting);
+        if (k == ArgKind::IMPURE) return false;
+        if (k == ArgKind::HEAVY) heavy++;
+    }
+    return heavy >= 2;
+}
+
+// Evaluates the items of a call node from first on into out as evaluate()
+// would, if they are a parallel candidate: the cheap ones here first, then
+// the heavy ones side by side on the ArgPool. False, with nothing
+// evaluated, otherwise.
+bool Interpreter::evaluate_parallel(ListValue *items, int first, const ContextPtr& c, ValuePtr *out)
+{
+    const ValuePtr *args = items->items() + first;
+    int n = items->size() - first;
+    std::vector<int> heavy;
+    std::vector<FunctionValue *> visiting;
+    std::vector<int> kinds(n);
+    for (int i=0; i<n; i++) {
+        kinds[i] = arg_kind(args[i], 0, visiting);
+        if (kinds[i] == ArgKind::IMPURE) return false;
+        if (kinds[i] == ArgKind::HEAVY) heavy.push_back(i);
+    }
+    if (heavy.size() < 2) return false;
+
+    // Pure, so the order they run in can't be told apart
+    for (int i=0; i<n; i++) {
+        if (kinds[i] != ArgKind::HEAVY) out[i] = evaluate(args[i], c);
+    }
+    if (!arg_pool) arg_pool = std::make_unique<ArgPool>(this, parallel_threads);
+    std::vector<ValuePtr> exprs, results(heavy.size());
+    for (int i : heavy) exprs.push_back(args[i]);
+    arg_pool->run(exprs.data(), results.data(), heavy.size(), c);
+    for (int j=0; j<heavy.size(); j++) out[heavy[j]] = std::move(results[j]);
+    return true;
+}
+
+ArgPool::ArgPool(Interpreter *m, int n) : main(m)
+{
+    for (int i=0; i<=n; i++) {
+        interps.push_back(std::make_unique<Interpreter>(main));
+    }
+    for (int i=1; i<=n; i++) {
+        Interpreter *w = interps[i].get();
+        threads.emplace_back([this, w] { work(w); });
+    }
+}
+
+ArgPool::~ArgPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+}
+
+// Evaluates expr in a frame of interp's that stands in for c
+static ValuePtr evaluate_job(Interpreter *interp, const ValuePtr& expr, const ContextPtr& c)
+{
+    ContextPtr proxy = Context::make(interp);
+    proxy->parent = c;
+    proxy->type = Symbol::func_symbol;
+    proxy->name = c->name;
+    proxy->stack_depth = c->stack_depth;
+    CodePtr code = Compiler::compile_form(expr, interp);
+    ValuePtr r = code ? interp->execute(code, proxy) : interp->evaluate(expr, proxy);
+    // As if wrapped by c, which the argument was evaluated in
+    if (r && r->type == Value::EXCEPTION) {
+        ExceptionValue *ev = static_cast<ExceptionValue *>(r.get());
+        if (!ev->trace.empty() && ev->trace.back() == proxy) {
+            ev->trace.back() = c;
+        } else if (ev->context == proxy) {
+            ev->context = c;
+        }
+    }
+    return r;
+}
+
+void ArgPool::drain(Interpreter *interp, std::unique_lock<std::mutex>& l)
+{
+    while (next < total) {
+        int i = next++;
+        l.unlock();
+        ValuePtr r = evaluate_job(interp, exprs[i], context);
+        l.lock();
+        results[i] = std::move(r);
+        if (++done == total) finished.notify_all();
+    }
+}
+
+void ArgPool::work(Interpreter *interp)
+{
+    // Everything a worker touches is shared with the thread it works for
+    RefCounted::threaded = true;
+    interp->mark_stack();
+    SlabPools::Use use(&interp->pools);
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> l(lock);
+    for (;;) {
+        wake.wait(l, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        drain(interp, l);
+    }
+}
+
+void ArgPool::run(const ValuePtr *e, ValuePtr *r, int n, const ContextPtr& c)
+{
+    Interpreter *self = interps[0].get();
+    self->native_depth = main->native_depth;
+    std::unique_lock<std::mutex> l(lock);
+    // Nothing pure rebinds a function, so the nodes the workers cache calls
+    // and parses for stay put until the batch is done, but not necessarily
+    // after. Call caches go with the parses, whose nodes they may be for.
+    for (auto& w : interps) {
+        w->worker_caches.clear();
+        w->worker_infix.clear();
+        w->budget.share(main->budget);
+    }
+    exprs = e;
+    results = r;
+    context = c;
+    next = 0;
+    total = n;
+    done = 0;
+    generation++;
+    batches++;
+    jobs += n;
+    // The workers share everything c reaches until the batch is done, so
+    // this thread counts atomically too meanwhile
+    RefCounted::threaded = true;
+    wake.notify_all();
+    drain(self, l);
+    finished.wait(l, [&] { return done == total; });
+    RefCounted::threaded = false;
+    context.reset();
+    for (auto& w : interps) main->budget.charge(w->budget);
+}
+
+}; // namespace squirrel
@@ -0,0 +1,67 @@
+#ifndef INCLUDED_SQUIRREL_PARALLEL_HPP
+#define INCLUDED_SQUIRREL_PARALLEL_HPP
+
+#include "value.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace squirrel {
+
+namespace Purity {
+    enum {
+        UNKNOWN,
+        PURE,       // body only reads variables and calls pure operators and functions
+        IMPURE
+    };
+};
+
+// How an argument expression may be evaluated off the calling thread
+namespace ArgKind {
+    enum {
+        IMPURE,     // may have side effects, or can't tell
+        CHEAP,      // pure, with no calls to user functions
+        HEAVY       // pure, and calls a user function
+    };
+};
+
+// Threads that evaluate the heavy arguments of a call side by side, for
+// Interpreter::parallel_threads. Each thread has an Interpreter of its own
+// that shares the main one's global context. Workers keep the call caches
+// and bytecode they make to themselves, make their frames on the heap, and
+// never write to anything they didn't create other than symbol versions and
+// reference counts, which are atomic while a batch runs, so pure
+// expressions can run on them while the calling thread waits.
+struct ArgPool {
+    uint64_t batches = 0;
+    uint64_t jobs = 0;
+
+    ArgPool(Interpreter *main, int threads);
+    ~ArgPool();
+
+    // Evaluates exprs[i] in c into results[i], for i < n, on the workers
+    // and the calling thread
+    void run(const ValuePtr *exprs, ValuePtr *results, int n, const ContextPtr& c);
+
+private:
+    Interpreter *main;
+    // interps[0] is used by the calling thread
+    std::vector<std::unique_ptr<Interpreter>> interps;
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    const ValuePtr *exprs = 0;
+    ValuePtr *results = 0;
+    ContextPtr context;
+    int next = 0, total = 0, done = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void work(Interpreter *interp);
+    void drain(Interpreter *interp, std::unique_lock<std::mutex>& l);
+};
+
+}; // namespace squirrel
+
+#endif
@@ -1,10 +1,12 @@
 #include "parser.hpp"
+#include "interpreter.hpp"
+#include <cmath>
 
 namespace squirrel {
 
-int Parser::parse_octal(const char *src, int len)
+int64_t Parser::parse_octal(const char *src, int len)
 {
-    int val = 0;
+    int64_t val = 0;
     while (len) {
         len--;
         int c = *src++ - '0';
@@ -13,28 +15,37 @@ int Parser::parse_octal(const char *src, int len)
     return val;
 }
 
-int Parser::parse_decimal(const char *src, int len)
+// IntValue, or BigIntValue if the digits don't fit in 64 bits
+ValuePtr Parser::parse_decimal(const char *src, int len)
 {
     std::cout << "Parse decimal: " << std::string_view(src, len) << std::endl;
-    int val = 0;
+    const char *start = src;
+    int start_len = len;
+    int64_t val = 0;
     bool neg = false;
     if (len && (*src == '-' || *src == '+')) {
         neg = (*src == '-');
         len--;
         src++;
     }
+    // Accumulated as a negative number, which has the larger range
     while (len) {
         len--;
         int c = *src++ - '0';
-        val = (val * 10) + c;
+        if (__builtin_mul_overflow(val, 10, &val) || __builtin_sub_overflow(val, c, &val)) {
+            return BigIntValue::make(BigInt::parse(start, start_len));
+        }
     }
-    if (neg) val = -val;
-    return val;
+    if (!neg) {
+        if (val == INT64_MIN) return BigIntValue::make(BigInt::parse(start, start_len));
+        val = -val;
+    }
+    return IntValue::make(val);
 }
 
-int Parser::parse_hex(const char *src, int len)
+int64_t Parser::parse_hex(const char *src, int len)
 {
-    int val = 0;
+    int64_t val = 0;
     while (len) {
         len--;
         int c = *src++;
@@ -112,9 +123,9 @@ int Parser::parse_string(const char *src, int len_in, char *dst)
     return len_out;
 }
 
-float Parser::parse_float(const char *str, int length)
+double Parser::parse_float(const char *str, int length)
 {
-    float result = 0.0f;
+    double result = 0.0;
     bool negative = false;
     bool decimalPointEncountered = false;
     int decimals = 0;
@@ -240,7 +251,7 @@ ValuePtr Parser::parse_number(Parsing& p)
             if (is_float) {
                 return FloatValue::make(parse_float(p.get_mark(), p.mark_len()));
             } else {
-                return IntValue::make(parse_decimal(p.get_mark(), p.mark_len()));
+                return parse_decimal(p.get_mark(), p.mark_len());
             }
         }
         break;
@@ -382,10 +393,7 @@ ValuePtr Parser::parse_token(Parsing& p)
     
     if (isdigit(first) || first == '.' || first == '-' || first == '+') {
         t = Parser::parse_number(p);
-        if (t) {
-            t->quote = quote;
-            return t;
-        }
+        if (t) return t.with_quote(quote);
     }
         
     t = parse_symbol(p);
@@ -53,11 +53,11 @@ struct Parsing {
 };
 
 struct Parser {
-    static int parse_octal(const char *src, int len);
-    static int parse_decimal(const char *src, int len);
-    static int parse_hex(const char *src, int len);
+    static int64_t parse_octal(const char *src, int len);
+    static ValuePtr parse_decimal(const char *src, int len);
+    static int64_t parse_hex(const char *src, int len);
     static int parse_string(const char *src, int len_in, char *dst);
-    static float parse_float(const char *str, int length);
+    static double parse_float(const char *str, int length);
     static ValuePtr parse_number(Parsing& p);
     static SymbolValuePtr parse_symbol(Parsing& p);
     static ValuePtr parse_token(Parsing& p);
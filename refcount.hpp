@@ -0,0 +1,278 @@
+#ifndef INCLUDED_SQUIRREL_REFCOUNT_HPP
+#define INCLUDED_SQUIRREL_REFCOUNT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+namespace squirrel {
+
+struct WeakBlock;
+struct RefCounted;
+
+// Which references a cycle collector follows out of an object, see gc.hpp
+namespace GcKind {
+    enum {
+        NONE,       // nothing it holds can lead back to it
+        VALUE,      // by Value::type
+        CONTEXT,
+        CODE,
+        NODE_SPEC,
+        JIT_CODE,
+        MEMO
+    };
+};
+
+// Defined in gc.cpp
+void suspect_cycle(const RefCounted *obj);
+void forget_cycle(const RefCounted *obj);
+
+// Base of everything held through a Ref, which keeps its reference count
+// in the object itself. An interpreter's objects belong to the thread
+// running it, so counting is plain arithmetic, except on a thread that has
+// threaded set: argument workers and the thread they work for set it for
+// as long as they share the objects (see ArgPool::run), and count
+// atomically meanwhile. Objects that every interpreter shares, such as
+// interned symbols, are marked with share() and always counted atomically.
+// A frozen object, such as an immediate's prototype, is never counted or
+// freed, so it can be shared by anything, from any thread.
+struct RefCounted {
+    static constexpr uint32_t FROZEN = ~uint32_t(0);
+    static inline thread_local bool threaded = false;
+
+    struct Frozen {};
+
+    constexpr RefCounted() {}
+    constexpr RefCounted(Frozen) : refs(FROZEN) {}
+    // A copy is a new object, which nothing refers to yet
+    RefCounted(const RefCounted& other) : gc_kind(other.gc_kind), gc_flags(other.gc_flags & GC_TRACKED) {}
+    RefCounted& operator=(const RefCounted&) { return *this; }
+    ~RefCounted() {
+        detach_weak();
+        detach_gc();
+    }
+
+    void retain() const {
+        if (!threaded && !(gc_flags & GC_SHARED)) {
+            if (refs != FROZEN) refs++;
+        } else if (count().load(std::memory_order_relaxed) != FROZEN) {
+            count().fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // True if that was the last reference
+    bool release() const {
+        if (!atomic()) return refs != FROZEN && --refs == 0;
+        if (count().load(std::memory_order_relaxed) == FROZEN) return false;
+        return count().fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    // Retains, unless the last reference has already gone
+    bool try_retain() const {
+        if (!atomic()) {
+            if (!refs) return false;
+            if (refs != FROZEN) refs++;
+            return true;
+        }
+        uint32_t n = count().load(std::memory_order_relaxed);
+        do {
+            if (!n) return false;
+            if (n == FROZEN) return true;
+        } while (!count().compare_exchange_weak(n, n+1, std::memory_order_relaxed));
+        return true;
+    }
+
+    // The block weak references share, made the first time one is taken
+    WeakBlock *weak_block() const;
+    // Weak references see the object as gone from here on
+    void detach_weak() const;
+
+    // release() as a Ref goes. If others are left, they may now be only
+    // those of a cycle, so an object that can be part of one becomes a
+    // candidate; anything else, or one already a candidate, costs just the
+    // test. Shared counts are never candidates.
+    bool drop_ref() const {
+        if (threaded || (gc_flags & GC_SHARED)) return release();
+        if (refs == FROZEN) return false;
+        if (--refs == 0) return true;
+        if ((gc_flags & (GC_TRACKED | GC_BUFFERED | GC_KEPT)) == GC_TRACKED) suspect_cycle(this);
+        return false;
+    }
+    // Counted atomically from then on, whatever thread it is on
+    void share() const { gc_flags |= GC_SHARED; }
+    // Collectors see the object as gone from here on
+    void detach_gc() const {
+        if (gc_flags & GC_BUFFERED) forget_cycle(this);
+    }
+
+protected:
+    // Every cycle goes through a value, context or code object, so only
+    // those are tracked as candidates; the rest are just traced through
+    void set_gc_kind(uint8_t k) {
+        gc_kind = k;
+        if (k == GcKind::VALUE || k == GcKind::CONTEXT || k == GcKind::CODE) {
+            gc_flags |= GC_TRACKED;
+        } else {
+            gc_flags &= ~GC_TRACKED;
+        }
+    }
+
+private:
+    friend struct CycleCollector;
+    friend void suspect_cycle(const RefCounted *obj);
+    friend void forget_cycle(const RefCounted *obj);
+
+    enum {
+        GC_COLOR = 3,           // collector's mark while it runs
+        GC_BUFFERED = 4,        // a candidate of collector gc_owner
+        GC_KEPT = 8,            // never traced into, see CycleCollector::keep
+        GC_TRACKED = 16,        // a candidate when a reference goes
+        GC_SHARED = 32          // counted atomically, see share()
+    };
+
+    mutable WeakBlock *weak = 0;
+    mutable uint32_t refs = 0;
+    uint8_t gc_kind = GcKind::NONE;
+    mutable uint8_t gc_flags = 0;
+    mutable uint16_t gc_owner = 0;
+
+    bool atomic() const { return threaded || (gc_flags & GC_SHARED); }
+    std::atomic_ref<uint32_t> count() const { return std::atomic_ref<uint32_t>(refs); }
+};
+
+// What weak references to an object hold on to instead of the object. The
+// object keeps one reference to it until it goes.
+struct WeakBlock {
+    const RefCounted *obj;
+    uint32_t refs = 1;
+    // Set if the object is counted atomically on every thread, see share()
+    bool shared = false;
+
+    void retain() {
+        if (shared || RefCounted::threaded) {
+            std::atomic_ref<uint32_t>(refs).fetch_add(1, std::memory_order_relaxed);
+        } else {
+            refs++;
+        }
+    }
+    void release() {
+        bool last = (shared || RefCounted::threaded) ? std::atomic_ref<uint32_t>(refs).fetch_sub(1, std::memory_order_acq_rel) == 1 : --refs == 0;
+        if (last) delete this;
+    }
+};
+
+inline WeakBlock *RefCounted::weak_block() const
+{
+    if (!atomic()) {
+        if (!weak) weak = new WeakBlock{this};
+        return weak;
+    }
+    std::atomic_ref<WeakBlock *> w(weak);
+    WeakBlock *b = w.load(std::memory_order_acquire);
+    if (b) return b;
+    WeakBlock *made = new WeakBlock{this, 1, bool(gc_flags & GC_SHARED)};
+    if (w.compare_exchange_strong(b, made, std::memory_order_acq_rel)) return made;
+    delete made;
+    return b;
+}
+
+inline void RefCounted::detach_weak() const
+{
+    if (!weak) return;
+    weak->obj = 0;
+    weak->release();
+    weak = 0;
+}
+
+// Counted reference to a T, which must derive from RefCounted. Otherwise
+// used like the std::shared_ptr it stands in for.
+template <class T>
+struct Ref {
+    Ref() {}
+    Ref(std::nullptr_t) {}
+    explicit Ref(T *q) : p(q) { if (p) p->retain(); }
+    Ref(const Ref& r) : p(r.p) { if (p) p->retain(); }
+    Ref(Ref&& r) : p(r.p) { r.p = 0; }
+    template <class U, class = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    Ref(const Ref<U>& r) : p(r.get()) { if (p) p->retain(); }
+    template <class U, class = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    Ref(Ref<U>&& r) : p(r.leak()) {}
+    ~Ref() { if (p) drop(p); }
+
+    Ref& operator=(const Ref& r) {
+        if (r.p) r.p->retain();
+        T *old = p;
+        p = r.p;
+        if (old) drop(old);
+        return *this;
+    }
+    Ref& operator=(Ref&& r) { Ref(std::move(r)).swap(*this); return *this; }
+
+    // Takes over a reference q already has counted for it
+    static Ref adopt(T *q) { Ref r; r.p = q; return r; }
+    // Gives up the reference, uncounted, to the caller
+    T *leak() { T *q = p; p = 0; return q; }
+
+    T *get() const { return p; }
+    T *operator->() const { return p; }
+    T& operator*() const { return *p; }
+    explicit operator bool() const { return p != 0; }
+    void reset() { Ref().swap(*this); }
+    void swap(Ref& r) { std::swap(p, r.p); }
+
+    template <class U>
+    friend bool operator==(const Ref& a, const Ref<U>& b) { return a.get() == b.get(); }
+    friend bool operator==(const Ref& a, std::nullptr_t) { return !a.p; }
+
+private:
+    T *p = 0;
+
+    static void drop(T *q) {
+        if (q->drop_ref()) delete q;
+    }
+};
+
+template <class T, class... Args>
+Ref<T> make_ref(Args&&... args) { return Ref<T>(new T(std::forward<Args>(args)...)); }
+
+template <class T, class U>
+Ref<T> static_pointer_cast(const Ref<U>& r) { return Ref<T>(static_cast<T *>(r.get())); }
+
+template <class T, class U>
+Ref<T> static_pointer_cast(Ref<U>&& r) { return Ref<T>::adopt(static_cast<T *>(r.leak())); }
+
+// Reference to a T that doesn't keep it alive. lock() must not race with
+// the last reference going on another thread, which the only threads that
+// share objects, argument workers, never let happen.
+template <class T>
+struct WeakRef {
+    WeakRef() {}
+    WeakRef(const Ref<T>& r) : p(r.get()), block(p ? p->weak_block() : 0) { if (block) block->retain(); }
+    WeakRef(const WeakRef& w) : p(w.p), block(w.block) { if (block) block->retain(); }
+    ~WeakRef() { if (block) block->release(); }
+
+    WeakRef& operator=(const WeakRef& w) {
+        WeakRef c(w);
+        std::swap(p, c.p);
+        std::swap(block, c.block);
+        return *this;
+    }
+
+    Ref<T> lock() const {
+        if (!block || !block->obj || !p->try_retain()) return 0;
+        return Ref<T>::adopt(p);
+    }
+    bool expired() const { return !block || !block->obj; }
+    // Refers to q, which is still there, or is empty and q is null
+    bool refers_to(const T *q) const { return p == q && (!p || block->obj); }
+
+private:
+    T *p = 0;
+    WeakBlock *block = 0;
+};
+
+}; // namespace squirrel
+
+#endif
@@ -0,0 +1,126 @@
+#include "slab.hpp"
+#include <new>
+#include <mutex>
+#include <algorithm>
+
+namespace squirrel {
+
+thread_local SlabPools *SlabPools::current = 0;
+
+// Never destroyed, as objects in statics are freed into it at exit
+static SlabPools& shared_pools()
+{
+    static SlabPools *pools = new SlabPools;
+    return *pools;
+}
+
+static std::mutex shared_lock;
+
+// The set a thread uses when none is bound, until the thread ends; after
+// that, which for the main thread is before statics are destroyed, the
+// shared one is used
+static thread_local SlabPools *thread_pools = 0;
+static thread_local bool thread_ended = false;
+
+struct ThreadEnd {
+    ~ThreadEnd() {
+        delete thread_pools;
+        thread_pools = 0;
+        thread_ended = true;
+    }
+};
+
+static thread_local ThreadEnd thread_end;
+
+void *SlabPool::allocate(size_t n)
+{
+    if (free_list) {
+        Block *b = free_list;
+        free_list = b->next;
+        stats.reused++;
+        return b;
+    }
+    if (chunk == chunk_end) {
+        if (!block_size) block_size = (std::max(n, sizeof(Block)) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        chunk = static_cast<char *>(::operator new(block_size * chunk_blocks));
+        chunk_end = chunk + block_size * chunk_blocks;
+        stats.chunks++;
+    }
+    void *p = chunk;
+    chunk += block_size;
+    stats.allocated++;
+    return p;
+}
+
+void SlabPool::free(void *p)
+{
+    Block *b = static_cast<Block *>(p);
+    b->next = free_list;
+    free_list = b;
+    stats.freed++;
+}
+
+void SlabPool::give(SlabPool& other)
+{
+    if (!other.free_list) {
+        other.free_list = free_list;
+        free_list = 0;
+    }
+    while (free_list) {
+        Block *b = free_list;
+        free_list = b->next;
+        b->next = other.free_list;
+        other.free_list = b;
+    }
+}
+
+SlabPools::~SlabPools()
+{
+    if (current == this) current = 0;
+    std::lock_guard<std::mutex> guard(shared_lock);
+    SlabPools& shared(shared_pools());
+    for (int k=0; k<SlabKind::COUNT; k++) pools[k].give(shared.pools[k]);
+}
+
+static SlabPools *thread_set()
+{
+    if (thread_pools || thread_ended) return thread_pools;
+    // Using thread_end has it destroyed when the thread ends
+    static_cast<void>(&thread_end);
+    return thread_pools = new SlabPools;
+}
+
+void *SlabPools::allocate(int kind, size_t n)
+{
+    SlabPools *s = current ? current : thread_set();
+    if (!s) {
+        std::lock_guard<std::mutex> guard(shared_lock);
+        return shared_pools().pools[kind].allocate(n);
+    }
+    SlabPool& pool(s->pools[kind]);
+    if (pool.exhausted()) {
+        std::lock_guard<std::mutex> guard(shared_lock);
+        shared_pools().pools[kind].give(pool);
+    }
+    return pool.allocate(n);
+}
+
+void SlabPools::free(int kind, void *p, size_t n)
+{
+    SlabPools *s = current ? current : thread_set();
+    if (s) return s->pools[kind].free(p);
+    std::lock_guard<std::mutex> guard(shared_lock);
+    shared_pools().pools[kind].free(p);
+}
+
+const char *SlabPools::name(int kind)
+{
+    static const char *names[SlabKind::COUNT] = {
+        "none", "list", "int", "string", "float", "operator", "symbol", "function",
+        "infix", "bool", "class", "object", "exception", "context value", "bigint", 0,
+        "context", "identifier", "index"
+    };
+    return names[kind];
+}
+
+}; // namespace squirrel
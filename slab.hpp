@@ -0,0 +1,99 @@
+#ifndef INCLUDED_SQUIRREL_SLAB_HPP
+#define INCLUDED_SQUIRREL_SLAB_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace squirrel {
+
+// Which pool an object comes from. Values use their type code, which is
+// always below CONTEXT.
+namespace SlabKind {
+    enum {
+        CONTEXT = 16,
+        IDENTIFIER,
+        INDEX,
+        COUNT
+    };
+};
+
+struct SlabStats {
+    uint64_t allocated = 0;     // blocks carved out of a chunk
+    uint64_t reused = 0;        // blocks taken back off the free list
+    uint64_t freed = 0;         // blocks put on the free list
+    uint64_t chunks = 0;        // chunks carved up
+
+    void reset() { *this = SlabStats(); }
+};
+
+// Blocks of one size, carved out of chunks and kept on a free list once
+// they are given back. Chunks are never returned: a block may be freed into
+// any pool of its kind, so memory a pool carved stays in use somewhere.
+struct SlabPool {
+    static constexpr int chunk_blocks = 64;
+
+    SlabStats stats;
+
+    // Every n is the same, the size of the pool's class
+    void *allocate(size_t n);
+    void free(void *p);
+    // Moves every free block over to other
+    void give(SlabPool& other);
+    // The next allocation would carve up a new chunk
+    bool exhausted() const { return !free_list && chunk == chunk_end; }
+
+private:
+    struct Block {
+        Block *next;
+    };
+    Block *free_list = 0;
+    char *chunk = 0, *chunk_end = 0;
+    size_t block_size = 0;
+};
+
+// A pool of each kind. Every interpreter has a set, which Use binds to the
+// thread while the interpreter runs, so that what it makes and frees comes
+// from and goes back to its own free lists with no locking. Argument
+// workers bind their own. With no set bound, a thread uses one of its own.
+// A set that goes hands its free blocks to a shared one, under a lock,
+// which a pool takes them back from before it carves up another chunk.
+struct SlabPools {
+    SlabPool pools[SlabKind::COUNT];
+
+    SlabPools() {}
+    SlabPools(const SlabPools&) = delete;
+    ~SlabPools();
+
+    static void *allocate(int kind, size_t n);
+    static void free(int kind, void *p, size_t n);
+
+    static const char *name(int kind);
+
+    struct Use {
+        SlabPools *previous;
+
+        Use(SlabPools *s) : previous(current) { current = s; }
+        ~Use() { current = previous; }
+    };
+
+private:
+    static thread_local SlabPools *current;
+};
+
+// Class-specific allocation for x, from the pool for kind. A subclass
+// that doesn't define its own is bigger, and goes to the heap.
+#define DEF_SLAB(x, kind) \
+    static void *operator new(size_t n) { \
+        return n == sizeof(x) ? SlabPools::allocate(kind, n) : ::operator new(n); \
+    } \
+    static void operator delete(void *p, size_t n) { \
+        if (n == sizeof(x)) { \
+            SlabPools::free(kind, p, n); \
+        } else { \
+            ::operator delete(p); \
+        } \
+    }
+
+}; // namespace squirrel
+
+#endif
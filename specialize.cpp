@@ -0,0 +1,166 @@
+#include "interpreter.hpp"
+
+namespace squirrel {
+
+static uint8_t type_pair(const ValuePtr& a, const ValuePtr& b)
+{
+    if (a->type == Value::INT && b->type == Value::INT) return SpecTypes::INT_INT;
+    if (a->type == Value::FLOAT && b->type == Value::FLOAT) return SpecTypes::FLOAT_FLOAT;
+    return SpecTypes::MIXED;
+}
+
+// Same results as the reduce/compare builtins produce for two operands
+// of the given pair, without the to_number() and as_int()/as_float() round trips.
+// Null if an INT result overflows, which the operator itself handles.
+static ValuePtr run_kernel(uint8_t kernel, uint8_t types, const ValuePtr& a, const ValuePtr& b)
+{
+    if (types == SpecTypes::INT_INT) {
+        int64_t x = a.ival();
+        int64_t y = b.ival();
+        int64_t r;
+        switch (kernel) {
+        case OpKernel::ADD: return __builtin_add_overflow(x, y, &r) ? 0 : IntValue::make(r);
+        case OpKernel::SUB: return __builtin_sub_overflow(x, y, &r) ? 0 : IntValue::make(r);
+        case OpKernel::MUL: return __builtin_mul_overflow(x, y, &r) ? 0 : IntValue::make(r);
+        case OpKernel::LT: return x < y ? Value::TRUE : Value::FALSE;
+        case OpKernel::GT: return y < x ? Value::TRUE : Value::FALSE;
+        case OpKernel::LE: return y < x ? Value::FALSE : Value::TRUE;
+        case OpKernel::GE: return x < y ? Value::FALSE : Value::TRUE;
+        case OpKernel::EQ: return x == y ? Value::TRUE : Value::FALSE;
+        case OpKernel::NE: return x == y ? Value::FALSE : Value::TRUE;
+        }
+    } else {
+        double x = a.fval();
+        double y = b.fval();
+        switch (kernel) {
+        case OpKernel::ADD: return FloatValue::make((0.0 + x) + y);
+        case OpKernel::SUB: return FloatValue::make(x - y);
+        case OpKernel::MUL: return FloatValue::make(x * y);
+        case OpKernel::LT: return x < y ? Value::TRUE : Value::FALSE;
+        case OpKernel::GT: return y < x ? Value::TRUE : Value::FALSE;
+        case OpKernel::LE: return y < x ? Value::FALSE : Value::TRUE;
+        case OpKernel::GE: return x < y ? Value::FALSE : Value::TRUE;
+        case OpKernel::EQ: return x == y ? Value::TRUE : Value::FALSE;
+        case OpKernel::NE: return x == y ? Value::FALSE : Value::TRUE;
+        }
+    }
+    return 0;
+}
+
+// A head can be cached if every lookup of it, from any context, ends in
+// the global dictionary: a plain symbol that was never bound anywhere else.
+// Any later binding bumps the symbol's version, which drops the cache.
+static bool cacheable(SymbolValuePtr name, ContextPtr exec_context, ContextPtr func_context)
+{
+    IdentifierPtr id = name->sym;
+    if (id->has_next()) return false;
+    IndexPtr first = id->first();
+    if (first->has_index()) return false;
+    SymbolPtr sym = first->sym;
+    if (sym->local_binding) return false;
+    if (sym == Symbol::parent_symbol || sym == Symbol::global_symbol || sym == Symbol::class_symbol ||
+        sym == Symbol::object_symbol || sym == Symbol::local_symbol) return false;
+    return exec_context && exec_context->vars.global && func_context == exec_context;
+}
+
+static void deoptimize(NodeSpec& spec, SpecStats& stats)
+{
+    if (spec.types == SpecTypes::INT_INT || spec.types == SpecTypes::FLOAT_FLOAT) stats.deoptimized++;
+    spec.types = SpecTypes::UNKNOWN;
+    spec.last_types = SpecTypes::UNKNOWN;
+    spec.observed = 0;
+    spec.deopts++;
+}
+
+// First call through a node: resolves the head and decides whether it
+// can be cached. Kept out of evaluate_call, whose frame every nested call
+// in this tier stacks up.
+ValuePtr Interpreter::evaluate_first_call(ListValuePtr node, SymbolValuePtr name, ContextPtr c)
+{
+    NodeSpec& spec(*node->spec);
+    ContextPtr exec_context, func_context;
+    ValuePtr func = CHECK_EXCEPTION_WRAP(resolve_function(name, c, exec_context, func_context, node.get()), c);
+    if (cacheable(name, exec_context, func_context)) {
+        spec.state = SpecState::CACHED;
+        spec.sym = name->sym->first()->sym;
+        spec.version = spec.sym->version;
+        spec.target = func;
+    } else {
+        spec.state = SpecState::GENERIC;
+    }
+    OperatorValue *ov = func->quote ? 0 : OperatorValue::with_arity(func, node->size() - 1);
+    if (ov) return CHECK_EXCEPTION_WRAP(call_fixed(ov, node.get(), 1, c), c);
+    if (func->type == Value::FUNC && !func->quote) {
+        return CHECK_EXCEPTION_WRAP(call_direct(static_pointer_cast<FunctionValue>(func), node.get(), 1, c, exec_context, func_context), c);
+    }
+    ListValuePtr args = node->sub(1);
+    if (!func->quote) args = evaluate_list(args, c);
+    return CHECK_EXCEPTION_WRAP(apply_function(func, args, c, exec_context, func_context), c);
+}
+
+ValuePtr Interpreter::evaluate_call(ListValuePtr node, SymbolValuePtr name, ContextPtr c)
+{
+    if (!node->spec) node->spec = NodeSpec::make();
+    NodeSpec& spec(*node->spec);
+
+    if (spec.state == SpecState::CACHED && spec.sym->version != spec.version) {
+        // Head was rebound since we cached it
+        deoptimize(spec, spec_stats);
+        spec.state = SpecState::UNINIT;
+        spec.target = 0;
+    }
+
+    if (spec.state == SpecState::GENERIC) {
+        return CHECK_EXCEPTION_WRAP(call_function(name, node.get(), 1, c), c);
+    }
+
+    if (spec.state == SpecState::UNINIT) return evaluate_first_call(node, name, c);
+
+    // CACHED: same checks resolve_function would make, minus the lookup
+    if (depth_exceeded(c)) {
+        return c->wrap_exception(ExceptionValue::make("Call stack limit exceeded: ", name, c));
+    }
+    ValuePtr func = spec.target;
+    if (func->quote) {
+        return CHECK_EXCEPTION_WRAP(apply_function(func, node->sub(1), c, global, global), c);
+    }
+
+    uint8_t kernel = func->type == Value::OPER ? static_cast<OperatorValue *>(func.get())->kernel : uint8_t(OpKernel::NONE);
+    if (kernel == OpKernel::NONE || node->size() != 3 || spec.deopts >= NodeSpec::max_deopts) {
+        OperatorValue *ov = OperatorValue::with_arity(func, node->size() - 1);
+        if (ov) return CHECK_EXCEPTION_WRAP(call_fixed(ov, node.get(), 1, c), c);
+        if (func->type == Value::FUNC) {
+            return CHECK_EXCEPTION_WRAP(call_direct(static_pointer_cast<FunctionValue>(func), node.get(), 1, c, global, global), c);
+        }
+        return CHECK_EXCEPTION_WRAP(apply_function(func, evaluate_list(node->sub(1), c), c, global, global), c);
+    }
+
+    ValuePtr a = evaluate(node->get(1), c);
+    ValuePtr b = evaluate(node->get(2), c);
+    uint8_t types = (a && b) ? type_pair(a, b) : uint8_t(SpecTypes::MIXED);
+    if (spec.types != SpecTypes::UNKNOWN) {
+        if (types == spec.types) {
+            spec_stats.fast_hits++;
+            ValuePtr r = run_kernel(kernel, types, a, b);
+            if (r) return r;
+        } else {
+            deoptimize(spec, spec_stats);
+        }
+    } else if (types != SpecTypes::MIXED) {
+        if (types == spec.last_types) {
+            spec.observed++;
+        } else {
+            spec.last_types = types;
+            spec.observed = 1;
+        }
+        if (spec.observed >= NodeSpec::specialize_after) {
+            spec.types = types;
+            spec_stats.specialized++;
+        }
+    }
+
+    // Operands are already evaluated; hand them to the operator as is
+    return CHECK_EXCEPTION_WRAP(static_cast<OperatorValue *>(func.get())->oper2(a, b, c), c);
+}
+
+}; // namespace squirrel
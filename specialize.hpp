@@ -0,0 +1,57 @@
+#ifndef INCLUDED_SQUIRREL_SPECIALIZE_HPP
+#define INCLUDED_SQUIRREL_SPECIALIZE_HPP
+
+#include "value.hpp"
+
+namespace squirrel {
+
+namespace SpecState {
+    enum {
+        UNINIT,     // not executed yet, or reset after its target changed
+        CACHED,     // head resolved once; target reused while the symbol is unchanged
+        GENERIC     // head can't be cached, always take the full call path
+    };
+};
+
+namespace SpecTypes {
+    enum {
+        UNKNOWN,
+        INT_INT,
+        FLOAT_FLOAT,
+        MIXED
+    };
+};
+
+// Per call node rewrite state. A node starts out UNINIT; the first run
+// resolves the head and, if it lives in the global context, keeps the
+// resolved operator or function. Binary operators with a kernel then record
+// the operand types they see, and after a few runs with the same pair the
+// node computes the result directly.
+struct NodeSpec : public RefCounted {
+    uint8_t state = SpecState::UNINIT;
+    uint8_t types = SpecTypes::UNKNOWN;
+    uint8_t last_types = SpecTypes::UNKNOWN;
+    uint8_t observed = 0;
+    uint8_t deopts = 0;
+    uint32_t version = 0;
+    SymbolPtr sym;
+    ValuePtr target;
+    
+    static constexpr int specialize_after = 2;
+    static constexpr int max_deopts = 4;
+    
+    NodeSpec() { set_gc_kind(GcKind::NODE_SPEC); }
+    static NodeSpecPtr make() { return make_ref<NodeSpec>(); }
+};
+
+struct SpecStats {
+    uint64_t specialized = 0;
+    uint64_t deoptimized = 0;
+    uint64_t fast_hits = 0;
+    
+    void reset() { *this = SpecStats(); }
+};
+
+}; // namespace squirrel
+
+#endif
@@ -1,6 +1,7 @@
 #include "symbol.hpp"
 #include <sstream>
-#include "value.hpp"
+#include "interpreter.hpp"
+#include <mutex>
 
 namespace squirrel {
 
@@ -13,7 +14,16 @@ std::ostream& operator<<(std::ostream& os, const Index& ix) {
     return os;
 }
 
-std::vector<SymbolWeakPtr> Symbol::interns;
+// Interned symbols by code. A symbol takes itself out when it goes, so the
+// table is never destroyed: symbols in other files' statics may outlast it.
+static std::vector<Symbol *>& interns()
+{
+    static std::vector<Symbol *> *table = new std::vector<Symbol *>;
+    return *table;
+}
+
+// Strings made by argument workers intern their symbols too
+static std::mutex interns_lock;
 
 SymbolPtr Symbol::empty_symbol = Symbol::find("");
 SymbolPtr Symbol::parent_symbol = Symbol::find("parent");
@@ -23,28 +33,41 @@ SymbolPtr Symbol::object_symbol = Symbol::find("object");
 SymbolPtr Symbol::local_symbol = Symbol::find("local");
 SymbolPtr Symbol::func_symbol = Symbol::find("func");
 
+// A symbol on its way out is still in the table, but can't be had
 SymbolPtr Symbol::find(const std::string_view& str)
 {
+    std::lock_guard<std::mutex> guard(interns_lock);
+    std::vector<Symbol *>& table(interns());
     int free_code = -1;
-    for (int i=0; i<interns.size(); i++) {
-        SymbolPtr s = interns[i].lock();
+    for (int i=0; i<table.size(); i++) {
+        Symbol *s = table[i];
         if (!s) {
             free_code = i;
-        } else {
-            if (str == s->str) return s;
+        } else if (str == s->str && s->try_retain()) {
+            return SymbolPtr::adopt(s);
         }
     }
     if (free_code < 0) {
-        free_code = interns.size();
-        interns.resize(free_code+1);
+        free_code = table.size();
+        table.resize(free_code+1);
     }
+    // Any interpreter, on any thread, can look the symbol up
     SymbolPtr s = Symbol::make();
+    s->share();
     s->str = str;
     s->code = free_code;
-    interns[free_code] = s;
+    table[free_code] = s.get();
     return s;  
 }
 
+Symbol::~Symbol()
+{
+    if (code < 0) return;
+    std::lock_guard<std::mutex> guard(interns_lock);
+    std::vector<Symbol *>& table(interns());
+    if (code < table.size() && table[code] == this) table[code] = 0;
+}
+
 std::string Identifier::as_string()
 {
     std::stringstream ss;
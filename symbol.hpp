@@ -8,25 +8,36 @@
 #include <string_view>
 #include <string>
 #include <iostream>
+#include <atomic>
 #include "types.hpp"
+#include "slab.hpp"
 
 namespace squirrel {
 
-struct Symbol {
+struct Symbol : public RefCounted {
     std::string str;
-    int code;
+    int code = -1;
+    
+    // Bumped on every set/unset of this symbol in any dictionary. Atomic
+    // only so that argument workers binding params don't race (see
+    // parallel.hpp); two bumps at once may count as one, which still
+    // changes the version.
+    std::atomic<uint32_t> version = 0;
+    // Set once the symbol has been bound anywhere other than the global context
+    std::atomic<bool> local_binding = false;
     
     Symbol() {}
     Symbol(const std::string_view& s_in, int ix) {
         str = s_in;
         code = ix;
     }
+    // Takes an interned symbol out of the table
+    ~Symbol();
     
-    static SymbolPtr make() { return std::make_shared<Symbol>(); }
+    static SymbolPtr make() { return make_ref<Symbol>(); }
     static SymbolPtr find(const std::string_view& str);
     static SymbolPtr make(const std::string_view& str) { return find(str); }
     
-    static std::vector<SymbolWeakPtr> interns;
     static SymbolPtr empty_symbol, parent_symbol, global_symbol, class_symbol, object_symbol, local_symbol, func_symbol;
     
     bool operator==(const Symbol& other) {
@@ -37,6 +48,12 @@ struct Symbol {
     }
     
     const std::string& as_string() { return str; }
+    
+    // Marks a set or unset, by a dictionary that is global or not
+    void bump(bool global) {
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (!global && !local_binding.load(std::memory_order_relaxed)) local_binding.store(true, std::memory_order_relaxed);
+    }
 };
 
 inline std::ostream& operator<<(std::ostream& os, const Symbol& s) {
@@ -53,24 +70,26 @@ inline std::ostream& operator<<(std::ostream& os, const SymbolPtr& s) {
     return os;
 }
 
-struct Index {
+struct Index : public RefCounted {
     SymbolPtr sym;
     ValuePtr index;
     
-    static IndexPtr make() { return std::make_shared<Index>(); }
+    DEF_SLAB(Index, SlabKind::INDEX)
+    
+    static IndexPtr make() { return make_ref<Index>(); }
     static IndexPtr make(const std::string_view& str) { 
-        IndexPtr ix = std::make_shared<Index>(); 
+        IndexPtr ix = make_ref<Index>(); 
         ix->sym = Symbol::make(str);
         return ix;
     }
     static IndexPtr make(const std::string_view& str, ValuePtr index_in) { 
-        IndexPtr ix = std::make_shared<Index>(); 
+        IndexPtr ix = make_ref<Index>(); 
         ix->sym = Symbol::make(str);
         ix->index = index_in;
         return ix;
     }
     static IndexPtr make(SymbolPtr sym, ValuePtr index_in) { 
-        IndexPtr ix = std::make_shared<Index>(); 
+        IndexPtr ix = make_ref<Index>(); 
         ix->sym = sym;
         ix->index = index_in;
         return ix;
@@ -100,7 +119,7 @@ inline std::ostream& operator<<(std::ostream& os, const IndexPtr& s) {
     return os;
 }
 
-struct Identifier : public std::enable_shared_from_this<Identifier> {
+struct Identifier : public RefCounted {
     std::vector<IndexPtr> syms;
 
     IdentifierPtr parent;
@@ -117,8 +136,10 @@ struct Identifier : public std::enable_shared_from_this<Identifier> {
     
     void append(const std::string_view& s) { append(Index::make(s)); }
     
+    DEF_SLAB(Identifier, SlabKind::IDENTIFIER)
+    
     static IdentifierPtr make() {
-        return std::make_shared<Identifier>();
+        return make_ref<Identifier>();
     }
     
     static IdentifierPtr make(const std::string_view& s);
@@ -136,7 +157,7 @@ struct Identifier : public std::enable_shared_from_this<Identifier> {
             n->parent = parent;
             n->offset = offset+1;
         } else {
-            n->parent = shared_from_this();
+            n->parent = IdentifierPtr(this);
             n->offset = 1;
         }
         return n;
@@ -156,7 +177,7 @@ struct Identifier : public std::enable_shared_from_this<Identifier> {
     
     IdentifierPtr original() {
         if (parent) return parent;
-        return shared_from_this();
+        return IdentifierPtr(this);
     }
     
     std::string as_string();
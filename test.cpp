@@ -2,15 +2,41 @@
 #include "parser.hpp"
 #include "interpreter.hpp"
 #include <iostream>
+#include <cstring>
 
 squirrel::ValuePtr test_op(squirrel::ValuePtr in, squirrel::ContextPtr con) {
     std::cout << "called test with: " << in << std::endl;
     return in;
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    // --quiet leaves out the interpreter's tracing, which differs between
+    // tiers, so that only results and what scripts print are written
+    bool quiet = false;
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--quiet")) quiet = true;
+    }
+    std::ostream results(std::cout.rdbuf());
+    if (quiet) std::cout.rdbuf(0);
     squirrel::Interpreter interp;
+    interp.output = &results;
+    
+    // Pick an execution tier, so the same script can be checked against each
+    bool stats = false;
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--tree")) interp.tier = squirrel::ExecTier::TREE;
+        if (!strcmp(argv[i], "--spec")) interp.tier = squirrel::ExecTier::SPECIALIZE;
+        if (!strcmp(argv[i], "--bytecode")) interp.tier = squirrel::ExecTier::BYTECODE;
+        if (!strcmp(argv[i], "--jit")) interp.tier = squirrel::ExecTier::JIT;
+        if (!strcmp(argv[i], "--jit-threshold") && i+1 < argc) interp.jit_threshold = atoi(argv[++i]);
+        if (!strcmp(argv[i], "--max-depth") && i+1 < argc) interp.max_depth = atoi(argv[++i]);
+        if (!strcmp(argv[i], "--no-inline-caches")) interp.inline_caches = false;
+        if (!strcmp(argv[i], "--parallel") && i+1 < argc) interp.parallel_threads = atoi(argv[++i]);
+        if (!strcmp(argv[i], "--fuel") && i+1 < argc) interp.budget.fuel = atoll(argv[++i]);
+        if (!strcmp(argv[i], "--timeout-ms") && i+1 < argc) interp.budget.timeout = std::chrono::milliseconds(atoi(argv[++i]));
+        if (!strcmp(argv[i], "--stats")) stats = true;
+    }
     
     // squirrel::ValuePtr v = squirrel::StringValue::make("Test string");
     // std::cout << v << std::endl;
@@ -44,9 +70,22 @@ int main()
     
     for (std::string line; std::getline(std::cin, line);) {
         squirrel::ValuePtr v = interp.evaluate(line);
-        if (v->type != squirrel::Value::NONE) std::cout << v << std::endl;
+        if (v->type != squirrel::Value::NONE) results << v << std::endl;
     }
     
+    if (stats) {
+        std::cerr << "inline caches: " << interp.cache_stats.hits << " hits, " << interp.cache_stats.misses << " misses, "
+                  << interp.cache_stats.megamorphic << " megamorphic" << std::endl;
+        const squirrel::GcStats& gc(interp.collector.stats);
+        std::cerr << "cycle collector: " << gc.runs << " runs, " << gc.roots << " roots, " << gc.traced << " traced, "
+                  << gc.freed << " freed, " << interp.collector.pending() << " pending" << std::endl;
+        for (int k=0; k<squirrel::SlabKind::COUNT; k++) {
+            const squirrel::SlabStats& s(interp.pools.pools[k].stats);
+            if (!s.allocated && !s.reused && !s.freed) continue;
+            std::cerr << squirrel::SlabPools::name(k) << " pool: " << s.allocated << " allocated, " << s.reused << " reused, "
+                      << s.freed << " freed, " << s.chunks << " chunks" << std::endl;
+        }
+    }
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Runs each script in this directory under every execution tier, and in the
+# modes that change how the bytecode tier runs, comparing what it prints
+# with the .expected file next to it. The JIT compiles a function after its
+# second call, so that scripts get as far as running native code. A script
+# that only holds in some modes, such as deep tail calls, which the tree
+# tiers don't make, or that needs limits set, lists its modes one per line
+# in a .modes file beside it.
+#
+# usage: tests/check.sh [interpreter], normally run by "make check"
+
+dir=$(dirname "$0")
+bin=${1:-$dir/../test}
+out=${TMPDIR:-/tmp}/squirrel-check.$$
+failed=0
+all_modes="--tree
+--spec
+--bytecode
+--jit --jit-threshold 2
+--bytecode --parallel 3"
+
+for script in "$dir"/*.sq; do
+    name=$(basename "$script" .sq)
+    if [ -f "$dir/$name.modes" ]; then
+        modes=$(cat "$dir/$name.modes")
+    else
+        modes=$all_modes
+    fi
+    while read -r mode; do
+        $bin --quiet $mode < "$script" > "$out" 2>&1
+        if ! cmp -s "$dir/$name.expected" "$out"; then
+            echo "FAIL $name $mode"
+            diff "$dir/$name.expected" "$out" | head -20
+            failed=1
+        fi
+    done <<EOF
+$modes
+EOF
+done
+
+rm -f "$out"
+if [ $failed = 0 ]; then echo "all scripts match"; fi
+exit $failed
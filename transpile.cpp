@@ -0,0 +1,373 @@
+#include "context.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+// Ahead-of-time translation of a script to C++.
+//
+//   transpile script.sq [module] > script.cpp
+//
+// Every top-level "func name {params} body..." becomes a built_in_f that
+// builds the function context the same way Interpreter::apply_function
+// does, and every top-level "class Name init..." becomes a native
+// initializer that runs the class body. Any other line is kept as source
+// and evaluated by the loader, in script order. The generated
+// load_<module>(Interpreter&) registers the functions with add_operator.
+//
+// Generated bodies follow Interpreter::evaluate step for step: heads are
+// looked up at call time, failures come back as ExceptionValues and are
+// wrapped with the calling context, and no-eval callees see the argument
+// expressions as written.
+
+using namespace squirrel;
+
+static std::string cpp_string(const std::string& s)
+{
+    std::ostringstream ss;
+    ss << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            ss << '\\' << c;
+        } else if (c < 32 || c >= 127) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", c);
+            ss << buf;
+        } else {
+            ss << c;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+static std::string cpp_ident(const std::string& s)
+{
+    std::string out;
+    for (unsigned char c : s) {
+        if (isalnum(c)) {
+            out += c;
+        } else {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "_%02x", c);
+            out += buf;
+        }
+    }
+    return out;
+}
+
+// Source lines are echoed in // comments; don't let one continue the comment
+static std::string comment(const std::string& s)
+{
+    if (!s.empty() && s.back() == '\\') return s + " ";
+    return s;
+}
+
+static bool is_plain_symbol(ValuePtr v)
+{
+    if (!v || v->type != Value::SYM) return false;
+    IdentifierPtr id = static_pointer_cast<SymbolValue>(v)->sym;
+    return id->has_first() && !id->has_next() && !id->first()->has_index();
+}
+
+static bool is_head(ListValuePtr form, const char *name)
+{
+    ValuePtr head = form->get(0);
+    if (!is_plain_symbol(head) || head->quote) return false;
+    return static_pointer_cast<SymbolValue>(head)->sym->first()->sym->as_string() == name;
+}
+
+struct Transpiler {
+    std::string module;
+    std::vector<std::string> consts;
+    std::ostringstream defs;
+    std::ostringstream loader;
+    int temps = 0;
+
+    // Constants are rebuilt structurally at load time
+    std::string construct(ValuePtr v)
+    {
+        if (!v) return "ValuePtr()";
+        std::string q = v->quote ? "true" : "false";
+        switch (v->type) {
+        case Value::INT: {
+            int64_t i = v.ival();
+            std::string lit = i == INT64_MIN ? "INT64_MIN" : "INT64_C(" + std::to_string(i) + ")";
+            return "sq_quote(IntValue::make(" + lit + "), " + q + ")";
+        }
+        case Value::BIGINT: {
+            std::string digits = static_pointer_cast<BigIntValue>(v)->big.to_string();
+            return "sq_quote(BigIntValue::make(BigInt::parse(" + cpp_string(digits) + ", " + std::to_string(digits.size()) + ")), " + q + ")";
+        }
+        case Value::FLOAT: {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%a", v.fval());
+            return std::string("sq_quote(FloatValue::make(") + buf + "), " + q + ")";
+        }
+        case Value::STR: {
+            const std::string& s = static_pointer_cast<StringValue>(v)->sym->as_string();
+            return "sq_quote(StringValue::make(std::string_view(" + cpp_string(s) + ", " + std::to_string(s.size()) + ")), " + q + ")";
+        }
+        case Value::SYM:
+            return "sq_quote(sq_parse(" + cpp_string(v.as_string()) + "), " + q + ")";
+        case Value::LIST:
+        case Value::INFIX: {
+            ListValuePtr l = static_pointer_cast<ListValue>(v);
+            std::string s = std::string("sq_list(") + (v->type == Value::INFIX ? "true" : "false") + ", " + q + ", {";
+            for (int i=0; i<l->size(); i++) {
+                if (i) s += ", ";
+                s += construct(l->get(i));
+            }
+            return s + "})";
+        }
+        default:
+            return "sq_quote(sq_parse(" + cpp_string(v.as_print_string()) + "), " + q + ")";
+        }
+    }
+
+    std::string add_const(ValuePtr v)
+    {
+        consts.push_back(construct(v));
+        return "k[" + std::to_string(consts.size() - 1) + "]";
+    }
+
+    std::string temp() { return "t" + std::to_string(temps++); }
+
+    static std::string pad(int indent) { return std::string(indent * 4, ' '); }
+
+    // Emit code computing v in context c; returns the temp holding it
+    std::string gen_expr(ValuePtr v, std::ostream& os, int indent)
+    {
+        std::string t = temp();
+        if (!v) {
+            os << pad(indent) << "ValuePtr " << t << ";\n";
+            return t;
+        }
+        if (!v->quote) {
+            if (v->type == Value::LIST) {
+                ListValuePtr l = static_pointer_cast<ListValue>(v);
+                ValuePtr head = l->get(0);
+                if (head && (head->type == Value::LIST || head->type == Value::INFIX)) {
+                    os << pad(indent) << "ValuePtr " << t << ";\n";
+                    gen_sequence(l, t, os, indent);
+                    return t;
+                }
+                if (head && head->type == Value::SYM) {
+                    gen_call(l, t, os, indent);
+                    return t;
+                }
+                if (!head || head->type == Value::EXCEPTION) {
+                    os << pad(indent) << "ValuePtr " << t << " = interp->evaluate(" << add_const(v) << ", c);\n";
+                    return t;
+                }
+            } else if (v->type == Value::SYM) {
+                os << pad(indent) << "ValuePtr " << t << " = c->get(" << add_const(v) << ", c);\n";
+                return t;
+            } else if (v->type == Value::INFIX) {
+                // Parsed against the operators bound when the program runs
+                os << pad(indent) << "ValuePtr " << t << " = interp->evaluate(" << add_const(v) << ", c);\n";
+                return t;
+            }
+        }
+        os << pad(indent) << "ValuePtr " << t << " = " << add_const(v) << ";\n";
+        return t;
+    }
+
+    void gen_sequence(ListValuePtr l, const std::string& out, std::ostream& os, int indent)
+    {
+        for (int i=0; i<l->size(); i++) {
+            std::string t = gen_expr(l->get(i), os, indent);
+            if (i == l->size()-1) os << pad(indent) << out << " = " << t << ";\n";
+        }
+    }
+
+    void gen_call(ListValuePtr node, const std::string& out, std::ostream& os, int indent)
+    {
+        std::string k = add_const(node);
+        std::string p = pad(indent);
+        std::string p1 = pad(indent+1);
+        os << p << "ValuePtr " << out << ";\n";
+        os << p << "{\n";
+        os << p1 << "ContextPtr exec_context, func_context;\n";
+        os << p1 << "ListValuePtr node = static_pointer_cast<ListValue>(" << k << ");\n";
+        os << p1 << "ValuePtr f = interp->resolve_function(static_pointer_cast<SymbolValue>(node->get(0)), c, exec_context, func_context, node.get());\n";
+        os << p1 << "if (f->type == Value::EXCEPTION) {\n";
+        os << pad(indent+2) << out << " = c->wrap_exception(f);\n";
+        os << p1 << "} else if (f->quote) {\n";
+        os << pad(indent+2) << out << " = sq_wrap(c, interp->apply_function(f, node->sub(1), c, exec_context, func_context));\n";
+        os << p1 << "} else {\n";
+        std::vector<std::string> args;
+        for (int i=1; i<node->size(); i++) args.push_back(gen_expr(node->get(i), os, indent+2));
+        std::string p2 = pad(indent+2);
+        int n = args.size();
+        if (n >= 1 && n <= 3) {
+            // Fixed-arity operators take the values directly
+            os << p2 << "if (OperatorValue *ov = OperatorValue::with_arity(f, " << n << ")) {\n";
+            os << pad(indent+3) << "ValuePtr a[] = {";
+            for (int i=0; i<n; i++) os << (i ? ", " : "") << args[i];
+            os << "};\n";
+            os << pad(indent+3) << out << " = sq_wrap(c, ov->call(a, " << n << ", c));\n";
+            os << p2 << "} else {\n";
+        }
+        std::string q = n >= 1 && n <= 3 ? pad(indent+3) : p2;
+        os << q << "ListValuePtr a = ListValue::make();\n";
+        for (const std::string& t : args) os << q << "a->append(" << t << ");\n";
+        os << q << out << " = sq_wrap(c, interp->apply_function(f, a, c, exec_context, func_context));\n";
+        if (n >= 1 && n <= 3) os << p2 << "}\n";
+        os << p1 << "}\n";
+        os << p << "}\n";
+    }
+
+    bool gen_func(ListValuePtr form, const std::string& source)
+    {
+        if (form->size() < 3) return false;
+        ValuePtr name = form->get(1);
+        ValuePtr params = form->get(2);
+        if (!is_plain_symbol(name) || !params || params->type != Value::LIST) return false;
+        ListValuePtr pl = static_pointer_cast<ListValue>(params);
+        for (int i=0; i<pl->size(); i++) {
+            if (!pl->get(i) || pl->get(i)->type != Value::SYM) return false;
+        }
+
+        std::string sname = static_pointer_cast<SymbolValue>(name)->sym->first()->sym->as_string();
+        std::string fn = "sq_func_" + cpp_ident(sname);
+        temps = 0;
+
+        std::ostringstream os;
+        os << "// " << comment(source) << "\n";
+        os << "static ValuePtr " << fn << "(ListValuePtr args, ContextPtr caller)\n{\n";
+        os << "    Interpreter *interp = caller->interp;\n";
+        // Calls between generated functions recurse natively, so they count
+        // against the same limits as Interpreter::run_body
+        os << "    if (interp->depth_exceeded(caller)) return ExceptionValue::make(\"Call stack limit exceeded: \", " << add_const(name) << ", caller);\n";
+        os << "    ContextPtr c = caller->make_function_context(Symbol::make(" << cpp_string(sname) << "));\n";
+        os << "    int n = std::min(args->size(), " << pl->size() << ");\n";
+        // Arguments are evaluated once, by the caller unless no-eval
+        bool no_eval = name->quote;
+        for (int i=0; i<pl->size(); i++) {
+            std::string pk = add_const(pl->get(i));
+            if (pl->quote) {
+                std::string rest = "args->sub(" + std::to_string(i) + ")";
+                os << "    if (n > " << i << ") c->set(" << pk << ", " << (no_eval ? "interp->evaluate_list(" + rest + ", caller)" : rest) << ", caller);\n";
+                break;
+            }
+            std::string arg = "args->get(" + std::to_string(i) + ")";
+            os << "    if (n > " << i << ") c->set(" << pk << ", " << (no_eval ? "interp->evaluate(" + arg + ", caller)" : arg) << ", caller);\n";
+        }
+        os << "    ValuePtr r;\n";
+        os << "    interp->native_depth++;\n";
+        gen_sequence(form->sub(3), "r", os, 1);
+        os << "    interp->native_depth--;\n";
+        os << "    return r;\n}\n\n";
+        defs << os.str();
+
+        loader << "    interp.add_operator(" << cpp_string(sname) << ", " << fn << ", 0, 0, " << (no_eval ? "NoEval" : "false") << ");\n";
+        return true;
+    }
+
+    bool gen_class(ListValuePtr form, const std::string& source)
+    {
+        if (form->size() < 2) return false;
+        ValuePtr name = form->get(1);
+        if (!is_plain_symbol(name) || name->quote) return false;
+        std::string sname = static_pointer_cast<SymbolValue>(name)->sym->first()->sym->as_string();
+        std::string fn = "sq_class_" + cpp_ident(sname);
+        std::string nk = add_const(name);
+        temps = 0;
+
+        // Mirrors builtin_defclass, with the class body compiled
+        std::ostringstream os;
+        os << "// " << comment(source) << "\n";
+        os << "static ValuePtr " << fn << "(ListValuePtr args, ContextPtr context)\n{\n";
+        os << "    Interpreter *interp = context->interp;\n";
+        os << "    SymbolPtr name = Symbol::make(" << cpp_string(sname) << ");\n";
+        os << "    ContextPtr exec_context, func_context;\n";
+        os << "    CHECK_EXCEPTION(context->find_owner(static_pointer_cast<SymbolValue>(" << nk << ")->sym, context, exec_context, func_context, true));\n";
+        os << "    ClassValuePtr cl = ClassValue::make();\n";
+        os << "    cl->name = name;\n";
+        os << "    cl->context = exec_context->make_class_context(name);\n";
+        os << "    CHECK_EXCEPTION(exec_context->set(name, cl));\n";
+        os << "    ContextPtr c = cl->context;\n";
+        os << "    ValuePtr r;\n";
+        gen_sequence(form->sub(2), "r", os, 1);
+        os << "    CHECK_EXCEPTION(r);\n";
+        os << "    return cl;\n}\n\n";
+        defs << os.str();
+
+        loader << "    " << fn << "(ListValue::make(), interp.global);\n";
+        return true;
+    }
+
+    void line(const std::string& source)
+    {
+        ValuePtr v = Parser::parse(source);
+        ListValuePtr form = static_pointer_cast<ListValue>(v);
+        if (form->size() == 0) return;
+        if (is_head(form, "func") && gen_func(form, source)) return;
+        if (is_head(form, "class") && gen_class(form, source)) return;
+        loader << "    interp.evaluate(std::string_view(" << cpp_string(source) << ", " << source.size() << "));\n";
+    }
+
+    void write(std::ostream& os)
+    {
+        os << "// Generated by transpile from module " << module << ". Do not edit.\n";
+        os << "#include \"interpreter.hpp\"\n\n";
+        os << "namespace squirrel {\n\n";
+        os << "static ValuePtr k[" << std::max<size_t>(consts.size(), 1) << "];\n\n";
+        os << "static ValuePtr sq_quote(ValuePtr v, bool quote) { return v.with_quote(quote); }\n";
+        os << "static ValuePtr sq_parse(const char *s) { return static_pointer_cast<ListValue>(Parser::parse(s))->get(0); }\n";
+        os << "static ValuePtr sq_wrap(ContextPtr c, ValuePtr r) { return (r && r->type == Value::EXCEPTION) ? c->wrap_exception(r) : r; }\n";
+        os << "static ValuePtr sq_list(bool infix, bool quote, std::initializer_list<ValuePtr> items)\n{\n";
+        os << "    ListValuePtr l = infix ? InfixValue::make() : ListValue::make();\n";
+        os << "    for (const ValuePtr& v : items) l->append(v);\n";
+        os << "    l->quote = quote;\n";
+        os << "    return l;\n}\n\n";
+        os << defs.str();
+        os << "void load_" << module << "(Interpreter& interp)\n{\n";
+        for (int i=0; i<consts.size(); i++) {
+            os << "    k[" << i << "] = " << consts[i] << ";\n";
+        }
+        os << loader.str();
+        os << "}\n\n";
+        os << "}; // namespace squirrel\n";
+    }
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " script [module]" << std::endl;
+        return 1;
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "Can't open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    Transpiler tr;
+    if (argc > 2) {
+        tr.module = argv[2];
+    } else {
+        std::string base(argv[1]);
+        size_t slash = base.find_last_of('/');
+        if (slash != std::string::npos) base = base.substr(slash + 1);
+        size_t dot = base.find('.');
+        if (dot != std::string::npos) base = base.substr(0, dot);
+        tr.module = cpp_ident(base);
+    }
+
+    // The parser reports progress on stdout; keep it out of the output
+    std::ostringstream sink;
+    std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+    for (std::string line; std::getline(in, line);) {
+        if (line.empty()) continue;
+        tr.line(line);
+    }
+    std::cout.rdbuf(out);
+
+    tr.write(std::cout);
+    return 0;
+}
@@ -1,19 +1,24 @@
 #ifndef INCLUDED_SQUIRREL_TYPES_HPP
 #define INCLUDED_SQUIRREL_TYPES_HPP
 
-#include <memory>
+#include "refcount.hpp"
+#include <cstdint>
+#include <string>
 
 namespace squirrel {
 
+// Copying or dropping a Ref needs the whole type, so a file that holds
+// values includes interpreter.hpp, which brings in everything one can hold
 #define DEF_SHARED_PTR(x) \
     struct x; \
-    typedef std::shared_ptr<x> x##Ptr;
+    typedef Ref<x> x##Ptr;
 
-DEF_SHARED_PTR(Value);
-DEF_SHARED_PTR(NoneValue);
-DEF_SHARED_PTR(BoolValue);
-DEF_SHARED_PTR(IntValue);
-DEF_SHARED_PTR(FloatValue);
+struct Value;
+struct NoneValue;
+struct BoolValue;
+struct IntValue;
+struct FloatValue;
+DEF_SHARED_PTR(BigIntValue);
 DEF_SHARED_PTR(StringValue);
 DEF_SHARED_PTR(SymbolValue);
 DEF_SHARED_PTR(ListValue);
@@ -26,12 +31,83 @@ DEF_SHARED_PTR(InfixValue);
 DEF_SHARED_PTR(ContextValue);
 DEF_SHARED_PTR(Context);
 DEF_SHARED_PTR(Dictionary);
+DEF_SHARED_PTR(SlotLayout);
 DEF_SHARED_PTR(Identifier);
 DEF_SHARED_PTR(Index);
+DEF_SHARED_PTR(Code);
+DEF_SHARED_PTR(NodeSpec);
+DEF_SHARED_PTR(JitCode);
+DEF_SHARED_PTR(CallCache);
+DEF_SHARED_PTR(MemoCache);
 
-struct Symbol;
-typedef std::shared_ptr<Symbol> SymbolPtr;
-typedef std::weak_ptr<Symbol> SymbolWeakPtr;
+// A value of any type. NONE, BOOL, INT and FLOAT are immediates, held in
+// imm with no allocation; ptr then points to a read-only prototype for the
+// type (see Value::prototype), which is frozen, so ->type and
+// ->quote read the same as for values on the heap. Anything that depends on
+// what an immediate holds has to go through the handle: ival(), fval(),
+// bval() and the conversions.
+struct ValuePtr {
+    Ref<Value> ptr;
+    union {
+        int64_t ival;
+        double fval;
+    } imm = {0};
+
+    ValuePtr() {}
+    ValuePtr(std::nullptr_t) {}
+    template <class T>
+    ValuePtr(const Ref<T>& v) : ptr(v) {}
+    template <class T>
+    ValuePtr(Ref<T>&& v) : ptr(std::move(v)) {}
+
+    // Immediate of the type of proto
+    static ValuePtr immediate(const Value *proto, int64_t bits) {
+        ValuePtr v;
+        v.ptr = Ref<Value>::adopt(const_cast<Value *>(proto));
+        v.imm.ival = bits;
+        return v;
+    }
+
+    Value *operator->() const { return ptr.get(); }
+    Value& operator*() const { return *ptr; }
+    Value *get() const { return ptr.get(); }
+    explicit operator bool() const { return (bool)ptr; }
+    void reset() { ptr.reset(); imm.ival = 0; }
+
+    int64_t ival() const { return imm.ival; }
+    double fval() const { return imm.fval; }
+    bool bval() const { return imm.ival != 0; }
+
+    // Defined in value.hpp
+    ValuePtr to_string() const;
+    ValuePtr to_int() const;
+    ValuePtr to_float() const;
+    ValuePtr to_number() const;
+    ValuePtr to_bool() const;
+    int64_t as_int() const;
+    double as_float() const;
+    std::string as_string() const;
+    std::string as_print_string() const;
+    bool as_bool() const;
+    // Same value, quoted or not: an immediate changes prototype, a value on
+    // the heap has its flag set
+    ValuePtr with_quote(bool q) const;
+
+    // Same heap object, or same immediate
+    friend bool operator==(const ValuePtr& a, const ValuePtr& b) { return a.ptr == b.ptr && a.imm.ival == b.imm.ival; }
+    friend bool operator==(const ValuePtr& a, std::nullptr_t) { return !a.ptr; }
+};
+
+// The heap object v points to, as a T
+template <class T>
+Ref<T> static_pointer_cast(const ValuePtr& v) { return static_pointer_cast<T>(v.ptr); }
+template <class T>
+Ref<T> static_pointer_cast(ValuePtr&& v) { return static_pointer_cast<T>(std::move(v.ptr)); }
+
+typedef WeakRef<Value> ValueWeakPtr;
+typedef WeakRef<Context> ContextWeakPtr;
+
+DEF_SHARED_PTR(Symbol);
 
 struct Interpreter;
 
@@ -43,6 +119,11 @@ struct Interpreter;
 
 typedef ValuePtr (*built_in_f)(ListValuePtr, ContextPtr);
 
+// Fixed-arity builtins take their arguments directly, with no argument list
+typedef ValuePtr (*built_in1_f)(const ValuePtr&, const ContextPtr&);
+typedef ValuePtr (*built_in2_f)(const ValuePtr&, const ValuePtr&, const ContextPtr&);
+typedef ValuePtr (*built_in3_f)(const ValuePtr&, const ValuePtr&, const ValuePtr&, const ContextPtr&);
+
 } // namespace squirrel
 
 #endif
\ No newline at end of file
@@ -1,11 +1,24 @@
 #include "value.hpp"
-#include "context.hpp"
+#include "interpreter.hpp"
 #include <sstream>
 #include "parser.hpp"
 
 namespace squirrel {
 
-ValuePtr Value::EMPTY_STR = StringValue::make(Symbol::empty_symbol);
+constinit const NoneValue NoneValue::prototype[2] = {NoneValue(false), NoneValue(true)};
+constinit const BoolValue BoolValue::prototype[2] = {BoolValue(false), BoolValue(true)};
+constinit const IntValue IntValue::prototype[2] = {IntValue(false), IntValue(true)};
+constinit const FloatValue FloatValue::prototype[2] = {FloatValue(false), FloatValue(true)};
+
+// Strings every interpreter hands out, from any thread
+static ValuePtr shared_string(SymbolPtr s)
+{
+    ValuePtr v = StringValue::make(s);
+    v->share();
+    return v;
+}
+
+ValuePtr Value::EMPTY_STR = shared_string(Symbol::empty_symbol);
 ValuePtr Value::ZERO_INT = IntValue::make(0);
 ValuePtr Value::ONE_INT = IntValue::make(1);
 ValuePtr Value::NEGONE_INT = IntValue::make(-1);
@@ -14,8 +27,8 @@ ValuePtr Value::ONE_FLOAT = FloatValue::make(1);
 ValuePtr Value::TRUE = BoolValue::make(true);
 ValuePtr Value::FALSE = BoolValue::make(false);
 
-ValuePtr BoolValue::TRUE_STR = StringValue::make(Symbol::find("true"));
-ValuePtr BoolValue::FALSE_STR = StringValue::make(Symbol::find("false"));
+ValuePtr BoolValue::TRUE_STR = shared_string(Symbol::find("true"));
+ValuePtr BoolValue::FALSE_STR = shared_string(Symbol::find("false"));
 
 static const char *type_names[] = {
     "NONE",
@@ -31,7 +44,8 @@ static const char *type_names[] = {
     "CLASS",
     "OBJECT",
     "EXCEPTION",
-    "CONTEXT"
+    "CONTEXT",
+    "BIGINT"
 };
 
 // XXX produce string based on type
@@ -58,55 +72,96 @@ SymbolPtr Value::get_name() const {
     return c->get_name();
 }
 
-NoneValuePtr NoneValue::none_value = std::make_shared<NoneValue>();
-
 ValuePtr NoneValue::to_string() const {
     return Value::EMPTY_STR;
 }
 
-ValuePtr BoolValue::to_string() const {
-    return bval ? TRUE_STR : FALSE_STR;
+ValuePtr ValuePtr::to_string() const {
+    std::stringstream ss;
+    switch (ptr->type) {
+    case Value::BOOL: return bval() ? BoolValue::TRUE_STR : BoolValue::FALSE_STR;
+    case Value::INT: ss << imm.ival; break;
+    case Value::FLOAT: ss << imm.fval; break;
+    default: return ptr->to_string();
+    }
+    return StringValue::make(ss.str());
 }
 
-ValuePtr BoolValue::to_int() const {
-    return bval ? ONE_INT : ZERO_INT;
+ValuePtr ValuePtr::to_int() const {
+    switch (ptr->type) {
+    case Value::BOOL: return bval() ? Value::ONE_INT : Value::ZERO_INT;
+    case Value::INT: return *this;
+    case Value::FLOAT:
+        // Out of range floats keep their integer part as a BigIntValue
+        if (imm.fval >= -9223372036854775808.0 && imm.fval < 9223372036854775808.0) return IntValue::make((int64_t)imm.fval);
+        return BigIntValue::make(BigInt::from_double(imm.fval));
+    default: return ptr->to_int();
+    }
 }
 
-ValuePtr BoolValue::to_float() const {
-    return bval ? ONE_FLOAT : ZERO_FLOAT;
+ValuePtr ValuePtr::to_float() const {
+    switch (ptr->type) {
+    case Value::BOOL: return bval() ? Value::ONE_FLOAT : Value::ZERO_FLOAT;
+    case Value::INT: return FloatValue::make(imm.ival);
+    case Value::FLOAT: return *this;
+    default: return ptr->to_float();
+    }
 }
 
-ValuePtr BoolValue::to_number() const { return to_int(); }
-ValuePtr BoolValue::to_bool() const { return bval ? TRUE : FALSE; }
-
+ValuePtr ValuePtr::to_bool() const {
+    switch (ptr->type) {
+    case Value::BOOL: return bval() ? Value::TRUE : Value::FALSE;
+    case Value::INT: return imm.ival ? Value::TRUE : Value::FALSE;
+    case Value::FLOAT: return imm.fval ? Value::TRUE : Value::FALSE;
+    default: return ptr->to_bool();
+    }
+}
 
-ValuePtr IntValue::to_string() const {
-    // std::cout << "int to_string\n";
-    std::stringstream ss;
-    ss << ival;
-    return StringValue::make(ss.str());
+std::string ValuePtr::as_string() const {
+    // std::cout << "As string: " << type_names[type] << std::endl;
+    ValuePtr s = to_string();
+    // std::cout << "Now calling as_string()\n";
+    return static_cast<StringValue *>(s.get())->sym->as_string();
 }
 
-ValuePtr IntValue::to_int() const { return std::const_pointer_cast<Value>(shared_from_this()); }
-ValuePtr IntValue::to_float() const { return FloatValue::make(ival); }
-ValuePtr IntValue::to_number() const { return to_int(); }
-ValuePtr IntValue::to_bool() const { return ival ? TRUE : FALSE; }
+std::string ValuePtr::as_print_string() const {
+    switch (ptr->type) {
+    case Value::NONE:
+    case Value::BOOL:
+    case Value::INT:
+    case Value::FLOAT: return ptr->quote ? std::string("\'") + as_string() : as_string();
+    default: return ptr->as_print_string();
+    }
+}
 
+ValuePtr ValuePtr::with_quote(bool q) const {
+    switch (ptr->type) {
+    case Value::NONE: return immediate(&NoneValue::prototype[q], imm.ival);
+    case Value::BOOL: return immediate(&BoolValue::prototype[q], imm.ival);
+    case Value::INT: return immediate(&IntValue::prototype[q], imm.ival);
+    case Value::FLOAT: return immediate(&FloatValue::prototype[q], imm.ival);
+    default: ptr->quote = q; return *this;
+    }
+}
 
-ValuePtr FloatValue::to_string() const {
-    std::stringstream ss;
-    ss << fval;
-    return StringValue::make(ss.str());
+ValuePtr BigIntValue::make(BigInt b)
+{
+    if (b.fits_int64()) return IntValue::make(b.to_int64());
+    BigIntValuePtr p = make();
+    p->big = std::move(b);
+    return p;
 }
 
-ValuePtr FloatValue::to_float() const { return std::const_pointer_cast<Value>(shared_from_this()); }
-ValuePtr FloatValue::to_int() const { return IntValue::make((int)fval); }
-ValuePtr FloatValue::to_number() const { return to_float(); }
-ValuePtr FloatValue::to_bool() const { return fval ? TRUE : FALSE; }
+ValuePtr BigIntValue::to_string() const { return StringValue::make(big.to_string()); }
+// Already an integer; as_int() takes the low 64 bits
+ValuePtr BigIntValue::to_int() const { return BigIntValuePtr(const_cast<BigIntValue *>(this)); }
+ValuePtr BigIntValue::to_float() const { return FloatValue::make(big.to_double()); }
+ValuePtr BigIntValue::to_number() const { return to_int(); }
+ValuePtr BigIntValue::to_bool() const { return big.is_zero() ? FALSE : TRUE; }
 
-ValuePtr StringValue::to_string() const { return std::const_pointer_cast<Value>(shared_from_this()); }
-ValuePtr StringValue::to_int() const { return to_number()->to_int(); }
-ValuePtr StringValue::to_float() const { return to_number()->to_float(); }
+ValuePtr StringValue::to_string() const { return StringValuePtr(const_cast<StringValue *>(this)); }
+ValuePtr StringValue::to_int() const { return to_number().to_int(); }
+ValuePtr StringValue::to_float() const { return to_number().to_float(); }
 ValuePtr StringValue::to_number() const {
     Parsing p(sym->str.data(), sym->str.size());
     ValuePtr t = Parser::parse_number(p);
@@ -127,13 +182,13 @@ ValuePtr SymbolValue::to_string() const {
 
 ContextPtr ContextValue::get_context() const { return context; }
 
-std::ostream& ListValue::print(std::ostream& os) const {
+std::ostream& ListValue::print(std::ostream& os, int from) const {
     bool first = true;
-    for (int i=0; i<size(); i++) {
+    for (int i=from; i<size(); i++) {
         if (!first) os << ' ';
         ValuePtr v = get(i);
         if (v) {
-            os << v->as_print_string();
+            os << v.as_print_string();
         } else {
             os << "[null]";
         }
@@ -158,26 +213,34 @@ ValuePtr ListValue::to_string() const {
     return StringValue::make(ss.str());
 }
 
-// XXX
+const std::string& ExceptionValue::message() const
+{
+    if (what) {
+        err = what;
+        if (subject) err += subject.as_string();
+        if (path) err += path->as_string();
+        what = 0;
+        subject.reset();
+        path.reset();
+    }
+    return err;
+}
+
+// Outermost frame first, down to where the exception was made
 ValuePtr ExceptionValue::to_string() const {
     std::stringstream ss;
-    std::shared_ptr<const ExceptionValue> p = std::static_pointer_cast<const ExceptionValue>(shared_from_this());
-    bool first = true;
-    while (p) {
-        //std::cout << err << " from " << p->get_context()->name << std::endl;
-        if (!first) ss << std::endl;
-        ContextPtr c = p->get_context();
-        if (c) {
-            if (p->err.size() > 0) {
-                ss << "Exception from " << c->name << ": " << p->err;
-            } else {
-                ss << "Exception from " << c->name;
-            }
+    for (int i=trace.size()-1; i>=0; i--) {
+        ss << "Exception from " << trace[i]->name << std::endl;
+    }
+    const std::string& m = message();
+    if (context) {
+        if (m.size() > 0) {
+            ss << "Exception from " << context->name << ": " << m;
         } else {
-            ss << p->err;
+            ss << "Exception from " << context->name;
         }
-        p = p->parent;
-        first = false;
+    } else {
+        ss << m;
     }
     return StringValue::make(ss.str());
 }
@@ -211,33 +274,11 @@ ValuePtr ContextValue::to_string() const
 
 
 
-int Value::as_int() const {
-    IntValuePtr s = std::static_pointer_cast<IntValue>(to_int());
-    return s->ival;
-}
-
-float Value::as_float() const {
-    FloatValuePtr s = std::static_pointer_cast<FloatValue>(to_float());
-    return s->fval;
-}
-
-bool Value::as_bool() const {
-    BoolValuePtr s = std::static_pointer_cast<BoolValue>(to_bool());
-    return s->bval;
-}
-
-std::string Value::as_string() const {
-    // std::cout << "As string: " << type_names[type] << std::endl;
-    StringValuePtr s = std::static_pointer_cast<StringValue>(to_string());
-    // std::cout << "Now calling as_string()\n";
-    return s->sym->as_string();
-}
-
 std::string Value::as_print_string() const { 
     if (quote) {
-        return std::string("\'") + as_string();
+        return std::string("\'") + to_string().as_string();
     } else {
-        return as_string(); 
+        return to_string().as_string(); 
     }
 }
 
@@ -2,17 +2,20 @@
 #define INCLUDED_SQUIRREL_VALUE_HPP
 
 #include "types.hpp"
-#include "enable_shared_from_base.hpp"
 #include "symbol.hpp"
+#include "slab.hpp"
+#include "bignum.hpp"
 #include <string_view>
 #include <algorithm>
+#include <bit>
 
 namespace squirrel {
 
 #define DEF_MAKE(x, t) \
-    static x##Ptr make() { x##Ptr p = std::make_shared<x>(); p->type = t; return p; }
+    static x##Ptr make() { x##Ptr p = make_ref<x>(); p->type = t; p->set_gc_kind(gc_kind_of(t)); return p; } \
+    DEF_SLAB(x, t)
 
-struct Value : public enable_shared_from_base<Value>  {
+struct Value : public RefCounted {
     enum {
         NONE,
         LIST,
@@ -27,23 +30,18 @@ struct Value : public enable_shared_from_base<Value>  {
         CLASS,
         OBJECT,
         EXCEPTION,
-        CONTEXT
+        CONTEXT,
+        BIGINT
     };
+    static_assert(int(BIGINT) < int(SlabKind::CONTEXT));
     
     uint8_t type;
     uint8_t quote;
     
-    virtual ValuePtr to_string() const;
-    virtual ValuePtr to_int() const;
-    virtual ValuePtr to_float() const;
-    virtual ValuePtr to_number() const;
-    virtual ValuePtr to_bool() const;
-    
-    int as_int() const;
-    float as_float() const;    
-    std::string as_string() const;
-    virtual std::string as_print_string() const;
-    bool as_bool() const;
+    Value() = default;
+    // Immediates' prototypes are frozen
+    constexpr Value(uint8_t t, uint8_t q) : RefCounted(Frozen()), type(t), quote(q) {}
+    virtual ~Value() {}
     
     bool has_context() {
         return type == CLASS || type == OBJECT || type == CONTEXT || type == EXCEPTION;
@@ -52,18 +50,25 @@ struct Value : public enable_shared_from_base<Value>  {
     virtual SymbolPtr get_name() const;
     virtual ContextPtr get_context() const;
     
+    // Types that can refer back to themselves, for the cycle collector
+    static constexpr uint8_t gc_kind_of(int t) {
+        return t == LIST || t == INFIX || t == FUNC || t == CLASS || t == OBJECT || t == EXCEPTION || t == CONTEXT ? GcKind::VALUE : GcKind::NONE;
+    }
+    
     static ValuePtr EMPTY_STR, ZERO_INT, ONE_INT, ZERO_FLOAT, ONE_FLOAT, NEGONE_INT, TRUE, FALSE;    
-};
 
-inline std::ostream& operator<<(std::ostream& os, const Value& s) {
-    os << s.as_string();
-    return os;
-}
+protected:
+    // Conversions of values on the heap; everything goes through the
+    // ValuePtr versions, which handle the immediates themselves
+    friend struct ValuePtr;
+    virtual ValuePtr to_string() const;
+    virtual ValuePtr to_int() const;
+    virtual ValuePtr to_float() const;
+    virtual ValuePtr to_number() const;
+    virtual ValuePtr to_bool() const;
+    virtual std::string as_print_string() const;
+};
 
-inline std::ostream& operator<<(std::ostream& os, const ValuePtr& s) {
-    os << (s ? s->as_string() : "[null value]");
-    return os;
-}
 
 ValuePtr wrap_exception(ValuePtr v, ContextPtr c);
 
@@ -71,15 +76,23 @@ ValuePtr wrap_exception(ValuePtr v, ContextPtr c);
     const ValuePtr& __val(v); \
     if (!__val) return ExceptionValue::make("Illegal null reference", (c)); \
     if (__val->type == Value::EXCEPTION) return ::squirrel::wrap_exception(__val, c); \
-    if (__val->type != type_code) return ExceptionValue::make(std::string("Expected " #type_code " type for: ") + __val->as_string(), (c)); \
-    std::static_pointer_cast<type_name>(__val); })
+    if (__val->type != type_code) return ExceptionValue::make("Expected " #type_code " type for: ", __val, (c)); \
+    static_pointer_cast<type_name>(__val); })
+
+// What an immediate of type_code holds, from ValuePtr's accessor
+#define CAST_IMMEDIATE(v, c, type_code, accessor) ({ \
+    const ValuePtr& __val(v); \
+    if (!__val) return ExceptionValue::make("Illegal null reference", (c)); \
+    if (__val->type == Value::EXCEPTION) return ::squirrel::wrap_exception(__val, c); \
+    if (__val->type != type_code) return ExceptionValue::make("Expected " #type_code " type for: ", __val, (c)); \
+    __val.accessor(); })
 
 #define CAST_CONTEXT(v, c) ({ \
     const ValuePtr& __val(v); \
     if (!__val) return ExceptionValue::make("Illegal null reference", (c)); \
     if (__val->type == Value::EXCEPTION) return ::squirrel::wrap_exception(__val, c); \
-    if (!__val->has_context()) return ExceptionValue::make(std::string("Expected context type for: ") + __val->as_string(), (c)); \
-    std::static_pointer_cast<ContextValue>(__val); })
+    if (!__val->has_context()) return ExceptionValue::make("Expected context type for: ", __val, (c)); \
+    static_pointer_cast<ContextValue>(__val); })
 
 #define GET_CONTEXT(v, c) ({ CAST_CONTEXT(v, c)->get_context(); })
         
@@ -87,18 +100,19 @@ ValuePtr wrap_exception(ValuePtr v, ContextPtr c);
     const ValuePtr& __val(v); \
     if (!__val) return ExceptionValue::make("Illegal null reference", (c)); \
     if (__val->type == Value::EXCEPTION) return ::squirrel::wrap_exception(__val, c); \
-    if (__val->type != Value::LIST && __val->type != Value::INFIX) return ExceptionValue::make(std::string("Expected list type for: ") + __val->as_string(), (c)); \
-    std::static_pointer_cast<ListValue>(__val); })
+    if (__val->type != Value::LIST && __val->type != Value::INFIX) return ExceptionValue::make("Expected list type for: ", __val, (c)); \
+    static_pointer_cast<ListValue>(__val); })
 
 #define CAST_EXCEPTION(v, c) ({ \
     const ValuePtr& __val(v); \
     if (!__val) return ExceptionValue::make("Illegal null reference", (c)); \
-    if (__val->type != Value::EXCEPTION) return ExceptionValue::make(std::string("Expected EXCEPTION type for: ") + __val->as_string(), (c)); \
-    std::static_pointer_cast<ExceptionValue>(__val); })
+    if (__val->type != Value::EXCEPTION) return ExceptionValue::make("Expected EXCEPTION type for: ", __val, (c)); \
+    static_pointer_cast<ExceptionValue>(__val); })
 
-#define CAST_BOOL(v, c) CAST_VALUE(v, c, Value::BOOL, BoolValue)
-#define CAST_INT(v, c) CAST_VALUE(v, c, Value::INT, IntValue)
-#define CAST_FLOAT(v, c) CAST_VALUE(v, c, Value::FLOAT, FloatValue)
+#define CAST_BOOL(v, c) CAST_IMMEDIATE(v, c, Value::BOOL, bval)
+#define CAST_INT(v, c) CAST_IMMEDIATE(v, c, Value::INT, ival)
+#define CAST_BIGINT(v, c) CAST_VALUE(v, c, Value::BIGINT, BigIntValue)
+#define CAST_FLOAT(v, c) CAST_IMMEDIATE(v, c, Value::FLOAT, fval)
 #define CAST_STRING(v, c) CAST_VALUE(v, c, Value::STR, StringValue)
 #define CAST_SYMBOL(v, c) CAST_VALUE(v, c, Value::SYM, SymbolValue)
 #define CAST_CLASS(v, c) CAST_VALUE(v, c, Value::CLASS, ClassValue)
@@ -107,52 +121,48 @@ ValuePtr wrap_exception(ValuePtr v, ContextPtr c);
 #define CAST_OPER(v, c) CAST_VALUE(v, c, Value::OPER, OperatorValue)
 #define CAST_INFIX(v, c) CAST_VALUE(v, c, Value::INFIX, InfixValue)
 
+// The immediate types have no objects of their own, only a prototype for
+// each quote flag, which a ValuePtr holding one points to
 struct NoneValue : public Value {
-    static NoneValuePtr none_value;
-    virtual ValuePtr to_string() const;
-    static NoneValuePtr make() {
-        return none_value;
+    static const NoneValue prototype[2];
+    constexpr NoneValue(bool q) : Value(NONE, q) {}
+    static ValuePtr make() {
+        return ValuePtr::immediate(&prototype[0], 0);
     }
+protected:
+    virtual ValuePtr to_string() const;
 };
 
 struct BoolValue : public Value {
-    uint8_t bval;
-
-    virtual ValuePtr to_string() const;
-    virtual ValuePtr to_int() const;
-    virtual ValuePtr to_float() const;
-    virtual ValuePtr to_number() const;
-    virtual ValuePtr to_bool() const;
-    
-    DEF_MAKE(BoolValue, BOOL);
-    static BoolValuePtr make(bool v) {
-        BoolValuePtr p = make();
-        p->bval = v;
-        return p;
+    static const BoolValue prototype[2];
+    constexpr BoolValue(bool q) : Value(BOOL, q) {}
+    static ValuePtr make(bool v, bool quote = false) {
+        return ValuePtr::immediate(&prototype[quote], v);
     }
     
     static ValuePtr TRUE_STR, FALSE_STR;
 };
 
 struct IntValue : public Value {
-    int ival;
-
-    virtual ValuePtr to_string() const;
-    virtual ValuePtr to_int() const;
-    virtual ValuePtr to_float() const;
-    virtual ValuePtr to_number() const;
-    virtual ValuePtr to_bool() const;
-
-    DEF_MAKE(IntValue, INT);
-    static IntValuePtr make(int v) {
-        IntValuePtr p = make();
-        p->ival = v;
-        return p;
+    static const IntValue prototype[2];
+    constexpr IntValue(bool q) : Value(INT, q) {}
+    static ValuePtr make(int64_t v, bool quote = false) {
+        return ValuePtr::immediate(&prototype[quote], v);
     }
 };
 
 struct FloatValue : public Value {
-    float fval;
+    static const FloatValue prototype[2];
+    constexpr FloatValue(bool q) : Value(FLOAT, q) {}
+    static ValuePtr make(double v, bool quote = false) {
+        return ValuePtr::immediate(&prototype[quote], std::bit_cast<int64_t>(v));
+    }
+};
+
+// An integer too large for IntValue. Arithmetic produces one only when a
+// result overflows 64 bits, and goes back to IntValue when it fits again.
+struct BigIntValue : public Value {
+    BigInt big;
 
     virtual ValuePtr to_string() const;
     virtual ValuePtr to_int() const;
@@ -160,12 +170,9 @@ struct FloatValue : public Value {
     virtual ValuePtr to_number() const;
     virtual ValuePtr to_bool() const;
     
-    DEF_MAKE(FloatValue, FLOAT);
-    static FloatValuePtr make(float v) {
-        FloatValuePtr p = make();
-        p->fval = v;
-        return p;
-    }
+    DEF_MAKE(BigIntValue, BIGINT);
+    // IntValue if b fits in 64 bits
+    static ValuePtr make(BigInt b);
 };
 
 struct StringValue : public Value {
@@ -235,8 +242,17 @@ struct ObjectValue : public ContextValue {
 };
 
 struct ExceptionValue : public ContextValue {
-    std::string err;
-    ExceptionValuePtr parent;
+    // The message is what followed by the string form of subject or path,
+    // built on first use by message(); err holds it from then on
+    mutable std::string err;
+    mutable const char *what = 0;
+    mutable ValuePtr subject;
+    mutable IdentifierPtr path;
+    // Frames the exception was passed out of, innermost first, from
+    // Context::wrap_exception. Only turned into text by to_string().
+    std::vector<ContextPtr> trace;
+    // Evaluation was stopped by Interpreter::budget
+    bool stopped = false;
     virtual ValuePtr to_string() const;
     DEF_MAKE(ExceptionValue, EXCEPTION);
     static ExceptionValuePtr make(const std::string& err, ContextPtr c) {
@@ -246,12 +262,43 @@ struct ExceptionValue : public ContextValue {
         p->context = c;
         return p;
     }
-    void setParent(ExceptionValuePtr p) { parent = p; }
+    static ExceptionValuePtr make(const char *what, ValuePtr subject, ContextPtr c) {
+        ExceptionValuePtr p = make();
+        p->what = what;
+        p->subject = std::move(subject);
+        p->context = c;
+        return p;
+    }
+    static ExceptionValuePtr make(const char *what, IdentifierPtr path, ContextPtr c) {
+        ExceptionValuePtr p = make();
+        p->what = what;
+        p->path = std::move(path);
+        p->context = c;
+        return p;
+    }
+    const std::string& message() const;
+    // Frame the exception was last passed out of
+    const ContextPtr& last_frame() const { return trace.empty() ? context : trace.back(); }
 };
 
 struct FunctionValue : public Value {
     SymbolPtr name;
     ListValuePtr params, body;
+    CodePtr code;
+    bool compile_failed = false;
+    // Frame layout for calls that don't run code: one slot per param.
+    // slot_params is set when params are distinct plain names, which then
+    // take the first slots of this layout and of code->layout, in order.
+    SlotLayoutPtr layout;
+    bool slot_params = false;
+    JitCodePtr jit;
+    bool jit_failed = false;
+    int calls = 0;
+    // Result cache, if the function has been memoized (see memo.hpp)
+    MemoCachePtr memo;
+    // See Interpreter::pure_function; valid while the guards' versions hold
+    uint8_t purity = 0;
+    std::vector<std::pair<SymbolPtr, uint32_t>> purity_guards;
     DEF_MAKE(FunctionValue, FUNC);
     virtual SymbolPtr get_name() const;
     // XXX set quote for no eval
@@ -262,6 +309,20 @@ struct OperatorValue : public Value {
     built_in_f oper;
     uint8_t precedence;
     uint8_t order;
+    uint8_t kernel = 0;
+    // Result depends only on the arguments, so calls with literal
+    // arguments can be folded at compile time
+    bool pure = false;
+    // Control form the compiler turns into jumps (see ControlOp)
+    uint8_t control = 0;
+    // Bit i set: argument i is passed unevaluated, for the operator to force
+    // with Interpreter::force. Bit 31 also covers every later argument.
+    // Operators with lazy arguments are registered no-eval.
+    uint32_t lazy = 0;
+    // Used instead of oper for calls with exactly 1, 2 or 3 arguments
+    built_in1_f oper1 = 0;
+    built_in2_f oper2 = 0;
+    built_in3_f oper3 = 0;
     DEF_MAKE(OperatorValue, OPER);
     static OperatorValuePtr make(SymbolPtr name, built_in_f f, uint8_t p, uint8_t o, bool no_eval) {
         OperatorValuePtr v = make();
@@ -273,6 +334,23 @@ struct OperatorValue : public Value {
         return v;
     }
     virtual SymbolPtr get_name() const;
+    
+    bool has_arity(int n) const {
+        return (n == 1 && oper1) || (n == 2 && oper2) || (n == 3 && oper3);
+    }
+    
+    ValuePtr call(const ValuePtr *args, int n, const ContextPtr& c) const {
+        if (n == 1) return oper1(args[0], c);
+        if (n == 2) return oper2(args[0], args[1], c);
+        return oper3(args[0], args[1], args[2], c);
+    }
+    
+    // f if it is an operator with an entry point for n arguments
+    static OperatorValue *with_arity(const ValuePtr& f, int n) {
+        if (!f || f->type != OPER) return 0;
+        OperatorValue *ov = static_cast<OperatorValue *>(f.get());
+        return ov->has_arity(n) ? ov : 0;
+    }
 };
 
 struct ListValue : public Value {
@@ -281,6 +359,11 @@ struct ListValue : public Value {
     ListValuePtr parent;
     int start, len;
     
+    // Execution state for call nodes, filled in by the specializing tier
+    NodeSpecPtr spec;
+    // Lookup cache for the head of a call node, see inline_cache.hpp
+    CallCachePtr cache;
+    
     DEF_MAKE(ListValue, LIST);
     
     void append(ValuePtr v) { list.push_back(v); }
@@ -300,7 +383,7 @@ struct ListValue : public Value {
             }
         } else {
             std::cout << "no parent\n";
-            p->parent = shared_from_base<ListValue>();
+            p->parent = ListValuePtr(this);
             p->start = s;
             if (l < 0) {
                 p->len = list.size() - s;
@@ -339,16 +422,67 @@ struct ListValue : public Value {
         return parent ? len : list.size();
     }
     
+    // The size() elements in order, read in place
+    const ValuePtr *items() const {
+        return parent ? parent->items() + start : list.data();
+    }
+    
     virtual ValuePtr to_string() const;
     
-    std::ostream& print(std::ostream& os) const;
+    // The items from first on, space separated
+    std::ostream& print(std::ostream& os, int first = 0) const;
 };
 
 struct InfixValue : public ListValue {
+    // Prefix call tree for this expression, built on first evaluation and
+    // kept while the operator symbols it was built from are unchanged
+    ValuePtr prefix;
+    std::vector<std::pair<SymbolPtr, uint32_t>> prefix_guards;
+    
     DEF_MAKE(InfixValue, INFIX);
     virtual ValuePtr to_string() const;
 };
 
+inline ValuePtr ValuePtr::to_number() const
+{
+    switch (ptr->type) {
+    case Value::INT:
+    case Value::FLOAT: return *this;
+    case Value::BOOL: return to_int();
+    default: return ptr->to_number();
+    }
+}
+
+inline int64_t ValuePtr::as_int() const
+{
+    if (ptr->type == Value::INT) return imm.ival;
+    ValuePtr v = to_int();
+    if (v->type == Value::BIGINT) return static_cast<BigIntValue *>(v.get())->big.to_int64();
+    return v.imm.ival;
+}
+
+inline double ValuePtr::as_float() const
+{
+    if (ptr->type == Value::FLOAT) return imm.fval;
+    return to_float().imm.fval;
+}
+
+inline bool ValuePtr::as_bool() const
+{
+    if (ptr->type == Value::BOOL) return imm.ival != 0;
+    return to_bool().imm.ival != 0;
+}
+
+// Numbers are written out directly, with no string value in between
+inline std::ostream& operator<<(std::ostream& os, const ValuePtr& s) {
+    if (!s) return os << "[null value]";
+    switch (s->type) {
+    case Value::INT: return os << s.ival();
+    case Value::FLOAT: return os << s.fval();
+    default: return os << s.as_string();
+    }
+}
+
 }; // namespace squirrel
 
 #endif
\ No newline at end of file
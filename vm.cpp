@@ -0,0 +1,292 @@
+#include "interpreter.hpp"
+
+namespace squirrel {
+
+ValuePtr Interpreter::load_global(GlobalRef& g, const ValuePtr& name, const ContextPtr& c)
+{
+    if (!g.sym->local_binding) {
+        if (!g.value || g.version != g.sym->version) {
+            auto i = global->vars.entries.find(g.sym->code);
+            g.value = i == global->vars.entries.end() ? 0 : i->second.second;
+            g.version = g.sym->version;
+        }
+        if (g.value) return g.value;
+    }
+    return c->get(name, c);
+}
+
+// Room for a frame's operands. Reserving exactly that much would copy the
+// whole stack again on every deeper call, so the capacity at least doubles.
+static void reserve_operands(std::vector<ValuePtr>& stack, size_t need)
+{
+    if (stack.capacity() < need) stack.reserve(std::max(need, 2*stack.capacity()));
+}
+
+// Dispatch loop for code produced by Compiler. The operand stack and the
+// stack of resolved-but-not-yet-called functions live in the interpreter and
+// are shared by nested invocations, each of which only touches the part
+// above its own base. Calls from compiled code to compiled functions don't
+// recurse: the caller's state is saved on vm_frames and the loop carries on
+// in the callee.
+ValuePtr Interpreter::execute(CodePtr code, ContextPtr c)
+{
+    if (!c) c = global;
+    
+    const Instr *ops = code->ops.data();
+    const ValuePtr *consts = code->consts.data();
+    int base = vm_stack.size();
+    int call_base = vm_calls.size();
+    int frame_base = vm_frames.size();
+    const int entry_base = base, entry_call_base = call_base;
+    // Where functions may be compiled to native code, frames kept here
+    // count against max_native_depth as well. Otherwise calls made before
+    // a function was compiled wouldn't count, and where the limit falls
+    // would depend on jit_threshold.
+    const int counted = tier == ExecTier::JIT;
+    reserve_operands(vm_stack, base + code->max_stack);
+    
+    // Slots are only usable if c is a frame made for this code
+    bool own_frame = code->layout && c->vars.layout == code->layout;
+    ValuePtr *frame = own_frame ? c->vars.slots.data() : 0;
+    
+    int pc = 0;
+    for (;;) {
+        const Instr& in(ops[pc++]);
+        switch (in.op) {
+        case Op::CONST:
+            vm_stack.push_back(consts[in.a]);
+            break;
+            
+        case Op::LOAD:
+            vm_stack.push_back(c->get(consts[in.a], c));
+            break;
+            
+        case Op::LOAD_LOCAL:
+            if (frame && frame[in.a]) {
+                vm_stack.push_back(frame[in.a]);
+            } else {
+                vm_stack.push_back(c->get(consts[in.b], c));
+            }
+            break;
+            
+        case Op::LOAD_GLOBAL:
+            vm_stack.push_back(load_global(code->globals[in.a], consts[in.b], c));
+            break;
+            
+        case Op::EVAL:
+            vm_stack.push_back(evaluate(consts[in.a], c));
+            break;
+            
+        case Op::POP:
+            vm_stack.pop_back();
+            break;
+            
+        case Op::RESOLVE: {
+            ListValuePtr node = static_pointer_cast<ListValue>(consts[in.a]);
+            SymbolValuePtr name = static_pointer_cast<SymbolValue>(node->get(0));
+            PendingCall call;
+            ValuePtr func = resolve_function(name, c, call.exec_context, call.func_context, node.get());
+            if (func->type == Value::EXCEPTION) {
+                vm_stack.push_back(c->wrap_exception(func));
+                pc = in.b;
+            } else if (func->quote) {
+                // No-eval callee gets the argument expressions as written
+                ValuePtr r = apply_function(func, node->sub(1), c, call.exec_context, call.func_context);
+                vm_stack.push_back(r && r->type == Value::EXCEPTION ? c->wrap_exception(r) : r);
+                pc = in.b;
+            } else {
+                call.func = func;
+                vm_calls.push_back(std::move(call));
+            }
+            break;
+        }
+            
+        case Op::CALL:
+        case Op::TAIL_CALL: {
+            PendingCall call = std::move(vm_calls.back());
+            vm_calls.pop_back();
+            
+            OperatorValue *ov = OperatorValue::with_arity(call.func, in.b);
+            if (ov) {
+                // Copied out first: the operator may run code that grows vm_stack
+                ValuePtr a[3];
+                std::move(vm_stack.end() - in.b, vm_stack.end(), a);
+                vm_stack.resize(vm_stack.size() - in.b);
+                ValuePtr r = ov->call(a, in.b, c);
+                vm_stack.push_back(r && r->type == Value::EXCEPTION ? c->wrap_exception(r) : r);
+                break;
+            }
+            
+            FunctionValuePtr fv = call.func->type == Value::FUNC ? static_pointer_cast<FunctionValue>(call.func) : 0;
+            if (!fv) {
+                ListValuePtr args = ListValue::make();
+                args->list.assign(std::make_move_iterator(vm_stack.end() - in.b), std::make_move_iterator(vm_stack.end()));
+                vm_stack.resize(vm_stack.size() - in.b);
+                ValuePtr r = apply_function(call.func, args, c, call.exec_context, call.func_context);
+                vm_stack.push_back(r && r->type == Value::EXCEPTION ? c->wrap_exception(r) : r);
+                break;
+            }
+            
+            if (fv->memo) {
+                int top = vm_stack.size() - in.b;
+                ValuePtr r = call_memo(fv, vm_stack.data() + top, in.b, c, call.exec_context, call.func_context);
+                vm_stack.resize(top);
+                vm_stack.push_back(r && r->type == Value::EXCEPTION ? c->wrap_exception(r) : r);
+                break;
+            }
+            
+            // Functions without bytecode, or with native code, run in a
+            // nested call as if through apply_function
+            CodePtr callee = function_code(fv);
+            bool nested = !callee || function_jit(fv);
+            
+            // Replace the current frame only if it is this code's own function
+            // frame and nothing in the callee can tell the difference
+            bool tail = !nested && in.op == Op::TAIL_CALL && own_frame && c->type == Symbol::func_symbol && !callee->uses_context_paths;
+            
+            // Params are bound straight from the stack; nothing runs before
+            // the arguments are popped that could grow it
+            ContextPtr nc;
+            ValuePtr err = enter_function(fv, vm_stack.data() + vm_stack.size() - in.b, in.b, c, call.exec_context, call.func_context, nc, tail);
+            vm_stack.resize(vm_stack.size() - in.b);
+            if (err) {
+                vm_stack.push_back(c->wrap_exception(err));
+                break;
+            }
+            if (nested) {
+                ValuePtr r = run_body(fv, nc);
+                vm_stack.push_back(r && r->type == Value::EXCEPTION ? c->wrap_exception(r) : r);
+                break;
+            }
+            if (tail) {
+                vm_stack.resize(base);
+                vm_calls.resize(call_base);
+            } else {
+                vm_frames.push_back(VmFrame{code, c, pc, base, call_base});
+                base = vm_stack.size();
+                call_base = vm_calls.size();
+                native_depth += counted;
+            }
+            code = callee;
+            ops = code->ops.data();
+            consts = code->consts.data();
+            c = nc;
+            own_frame = true;
+            frame = c->vars.slots.data();
+            reserve_operands(vm_stack, base + code->max_stack);
+            pc = 0;
+            break;
+        }
+            
+        case Op::RETURN: {
+            ValuePtr r = std::move(vm_stack.back());
+            vm_stack.resize(base);
+            vm_calls.resize(call_base);
+            if (vm_frames.size() == frame_base) return r;
+            
+            // Back to the calling frame, as if apply_function had returned
+            VmFrame& f(vm_frames.back());
+            code = std::move(f.code);
+            c = std::move(f.c);
+            pc = f.pc;
+            base = f.base;
+            call_base = f.call_base;
+            vm_frames.pop_back();
+            native_depth -= counted;
+            ops = code->ops.data();
+            consts = code->consts.data();
+            own_frame = code->layout && c->vars.layout == code->layout;
+            frame = own_frame ? c->vars.slots.data() : 0;
+            vm_stack.push_back(r && r->type == Value::EXCEPTION ? c->wrap_exception(r) : r);
+            break;
+        }
+
+        case Op::JUMP:
+            // Loops jump back, so each time round costs a step
+            if (in.a < pc && !budget.step()) {
+                vm_stack.resize(entry_base);
+                vm_calls.resize(entry_call_base);
+                native_depth -= counted * (vm_frames.size() - frame_base);
+                vm_frames.resize(frame_base);
+                return stopped(c);
+            }
+            pc = in.a;
+            break;
+
+        case Op::JUMP_IF_NOT: {
+            ValuePtr v = std::move(vm_stack.back());
+            vm_stack.pop_back();
+            if (v && v->type == Value::EXCEPTION) {
+                vm_stack.push_back(c->wrap_exception(v));
+                pc = in.b;
+            } else if (!v || !v.as_bool()) {
+                pc = in.a;
+            }
+            break;
+        }
+
+        case Op::JUMP_IF_EXC:
+        case Op::CHECK_VALUE: {
+            ValuePtr& v(vm_stack.back());
+            if (v && v->type == Value::EXCEPTION) {
+                v = c->wrap_exception(v);
+                pc = in.a;
+            } else if (!v && in.op == Op::CHECK_VALUE) {
+                v = ExceptionValue::make("Illegal null reference", c);
+                pc = in.a;
+            }
+            break;
+        }
+
+        case Op::NIP:
+            vm_stack.erase(vm_stack.end() - 1 - in.a, vm_stack.end() - 1);
+            break;
+
+        case Op::FOR_PREP: {
+            ValuePtr *top = &vm_stack.back();
+            top[-1] = IntValue::make(top[-1].as_int());
+            top[0] = IntValue::make(top[0].as_int());
+            vm_stack.emplace_back();
+            vm_stack.push_back(NoneValue::make());
+            break;
+        }
+
+        case Op::FOR_NEXT: {
+            ValuePtr *top = &vm_stack.back();
+            int64_t& counter(top[-3].imm.ival);
+            if (counter >= top[-2].ival()) {
+                pc = in.a;
+                break;
+            }
+            bind_counter(c->vars, static_cast<SymbolValue *>(consts[in.b].get())->sym->first()->sym, top[-1], counter++);
+            break;
+        }
+
+        case Op::EACH_PREP: {
+            ValuePtr& v(vm_stack.back());
+            if (v->type != Value::LIST && v->type != Value::INFIX) {
+                v = ExceptionValue::make("Expected list type for: ", v, c);
+                pc = in.a;
+                break;
+            }
+            vm_stack.push_back(IntValue::make(0));
+            vm_stack.push_back(NoneValue::make());
+            break;
+        }
+
+        case Op::EACH_NEXT: {
+            ValuePtr *top = &vm_stack.back();
+            ListValue *items = static_cast<ListValue *>(top[-2].get());
+            int64_t& index(top[-1].imm.ival);
+            if (index >= items->size()) {
+                pc = in.a;
+                break;
+            }
+            c->vars.set(static_cast<SymbolValue *>(consts[in.b].get())->sym->first()->sym, items->get(index++));
+            break;
+        }
+        }
+    }
+}
+
+}; // namespace squirrel